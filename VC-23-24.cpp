@@ -10,17 +10,24 @@
 #include <fstream>
 #include <vector>
 #include <filesystem>
-#include <map>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 
 extern "C"
 {
 #include "vc.h"
 }
 
-void vc_timer(void)
+// Na segunda chamada mostra e devolve o tempo decorrido (em segundos) desde a primeira;
+// com pausa = false não espera por uma tecla (modo sem interface)
+double vc_timer(bool pausa = true)
 {
 	static bool running = false;
 	static std::chrono::steady_clock::time_point previousTime = std::chrono::steady_clock::now();
+	double nseconds = 0.0;
 
 	if (!running)
 	{
@@ -33,89 +40,428 @@ void vc_timer(void)
 
 		// Tempo em segundos.
 		std::chrono::duration<double> time_span = std::chrono::duration_cast<std::chrono::duration<double>>(elapsedTime);
-		double nseconds = time_span.count();
+		nseconds = time_span.count();
 
 		std::cout << "Tempo decorrido: " << nseconds << "segundos" << std::endl;
-		std::cout << "Pressione qualquer tecla para continuar...\n";
-		std::cin.get();
+		if (pausa)
+		{
+			std::cout << "Pressione qualquer tecla para continuar...\n";
+			std::cin.get();
+		}
 	}
+
+	return nseconds;
 }
 
-// Tabela de cores de resistores
-std::map<std::string, int> colorValueMap = {
-	{"Preto", 0},
-	{"Castanho", 1},
-	{"Vermelho", 2},
-	{"Laranja", 3},
-	{"Amarelo", 4},
-	{"Verde", 5},
-	{"Azul", 6},
-	{"Violeta", 7},
-	{"Cinzento", 8},
-	{"Branco", 9}
-};
+// Fases medidas em cada frame. A conversão para HSV e a segmentação são uma só chamada
+// (vc_rgb_to_hsv_segmentation), tal como a etiquetagem e a informação dos blobs (vc_rle_blob_labelling)
+enum Fase { FASE_LEITURA, FASE_MOVIMENTO, FASE_HSV_SEGMENTACAO, FASE_DILATACAO, FASE_ETIQUETAGEM, FASE_CORES, FASE_APRESENTACAO, NFASES };
+const char* const nomesFases[NFASES] = { "leitura", "movimento", "hsv_segmentacao", "dilatacao", "etiquetagem", "cores", "apresentacao" };
+
+typedef std::chrono::steady_clock Relogio;
+
+// Milissegundos decorridos desde inicio (relógio monotónico)
+double msDesde(Relogio::time_point inicio)
+{
+	return std::chrono::duration<double, std::milli>(Relogio::now() - inicio).count();
+}
+
+// Tempos por fase de todas as frames (ms; negativo = a fase não correu nessa frame, p.ex. cores sem resistência)
+// Só a fase de apresentação regista, pelo que não precisa de sincronização
+class Instrumentacao
+{
+public:
+	void reservar(int nframes)
+	{
+		if (nframes <= 0)
+			return;
+		frames.reserve(nframes);
+		for (int f = 0; f < NFASES; f++)
+			amostras[f].reserve(nframes);
+	}
+
+	void registar(int nframe, const double* tempos)
+	{
+		frames.push_back(nframe);
+		for (int f = 0; f < NFASES; f++)
+			amostras[f].push_back((float)tempos[f]);
+	}
+
+	// Mínimo, média, p50 e p99 de cada fase, e frames por segundo no tempo total (segundos)
+	void resumo(std::ostream& os, double segundos) const
+	{
+		char linha[160];
+
+		std::snprintf(linha, sizeof(linha), "%-16s %8s %10s %10s %10s %10s\n", "fase (ms)", "frames", "min", "media", "p50", "p99");
+		os << linha;
+		for (int f = 0; f < NFASES; f++)
+		{
+			std::vector<float> v;
+			v.reserve(amostras[f].size());
+			for (float t : amostras[f])
+				if (t >= 0.0f) v.push_back(t);
+			if (v.empty())
+				continue;
+
+			std::sort(v.begin(), v.end());
+			double soma = 0.0;
+			for (float t : v)
+				soma += t;
+
+			std::snprintf(linha, sizeof(linha), "%-16s %8d %10.3f %10.3f %10.3f %10.3f\n", nomesFases[f], (int)v.size(),
+				v.front(), soma / v.size(), percentil(v, 0.50), percentil(v, 0.99));
+			os << linha;
+		}
+		std::snprintf(linha, sizeof(linha), "%d frames em %.3f s: %.2f FPS\n", (int)frames.size(), segundos, segundos > 0.0 ? frames.size() / segundos : 0.0);
+		os << linha;
+	}
+
+	// Uma linha por frame: número da frame e tempo de cada fase (vazio se a fase não correu)
+	bool escreverCSV(const std::string& ficheiro) const
+	{
+		std::ofstream csv(ficheiro);
+		if (!csv)
+			return false;
+
+		csv << "frame";
+		for (int f = 0; f < NFASES; f++)
+			csv << "," << nomesFases[f];
+		csv << "\n";
+		for (size_t i = 0; i < frames.size(); i++)
+		{
+			csv << frames[i];
+			for (int f = 0; f < NFASES; f++)
+			{
+				csv << ",";
+				if (amostras[f][i] >= 0.0f) csv << amostras[f][i];
+			}
+			csv << "\n";
+		}
+
+		return (bool)csv;
+	}
 
-// Tabela de multiplicadores de resistores
-std::map<std::string, float> multiplierMap = {
-	{"Preto", 1},
-	{"Castanho", 10},
-	{"Vermelho", 100},
-	{"Laranja", 1000},
-	{"Amarelo", 10000},
-	{"Verde", 100000},
-	{"Azul", 1000000},
-	{"Dourado", 0.1},
-	{"Cinzento", 0.01}
+private:
+	// Percentil pelo método do posto mais próximo (v ordenado e não vazio)
+	static float percentil(const std::vector<float>& v, double p)
+	{
+		size_t posto = (size_t)std::ceil(p * v.size());
+		return v[posto > 0 ? posto - 1 : 0];
+	}
+
+	std::vector<int> frames;
+	std::vector<float> amostras[NFASES];
 };
 
-// Tabela de tolerâncias de resistores
-std::map<std::string, float> toleranceMap = {
-	{"Castanho", 1.0f},
-	{"Vermelho", 2.0f},
-	{"Dourado", 5.0f},
-	{"Cinzento", 10.0f}
+// Cores das faixas dos resistores (os dez primeiros valores são também o dígito de cada cor)
+enum Cor { COR_PRETO, COR_CASTANHO, COR_VERMELHO, COR_LARANJA, COR_AMARELO, COR_VERDE, COR_AZUL, COR_VIOLETA, COR_CINZENTO, COR_BRANCO,
+	COR_DOURADO, COR_DESCONHECIDA, NCORES };
+const char* const nomesCores[NCORES] = { "Preto", "Castanho", "Vermelho", "Laranja", "Amarelo", "Verde", "Azul", "Violeta", "Cinzento", "Branco",
+	"Dourado", "Desconhecido" };
+
+// Tabela de cores de resistores (dígito; -1 = a cor não pode ser um dígito)
+const int valorCor[NCORES] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, -1, -1 };
+
+// Tabela de multiplicadores de resistores (0 = a cor não pode ser o multiplicador)
+const float multiplicadorCor[NCORES] = { 1.0f, 10.0f, 100.0f, 1000.0f, 10000.0f, 100000.0f, 1000000.0f, 0.0f, 0.01f, 0.0f, 0.1f, 0.0f };
+
+// Tabela de tolerâncias de resistores em % (0 = a cor não pode ser a tolerância)
+const int toleranciaCor[NCORES] = { 0, 1, 2, 0, 0, 0, 0, 0, 10, 0, 5, 0 };
+
+// Tabela de valores das cores de cada faixa (intervalos de hue, inclusivos)
+// Os intervalos sobrepõem-se: vale o primeiro da tabela que contém o hue
+struct FaixaHue
+{
+	Cor cor;
+	int min, max;
+};
+constexpr FaixaHue faixasHue[] = {
+	{ COR_AZUL, 75, 135 },			// Azul varia de 75 a 135
+	{ COR_CASTANHO, 10, 25 },		// Castanho pode variar de 10 a 20
+	{ COR_DOURADO, 25, 35 },		// Dourado varia de 20 a 30
+	{ COR_LARANJA, 25, 35 },		// Laranja varia de 20 a 30
+	{ COR_VERDE, 35, 85 },			// Verde varia de 45 a 85
+	{ COR_VERMELHO, 0, 10 },		// Vermelho varia de 0 a 10
+	{ COR_VIOLETA, 135, 150 }		// Violeta varia de 135 a 150
 };
 
-// Tabela de valores das cores de cada faixa
-std::map<std::string, std::pair<int, int>> HueColorMap = {
-	{"Castanho", {10, 25}},    // Castanho pode variar de 10 a 20
-	{"Vermelho", {0, 10}},     // Vermelho varia de 0 a 10
-	{"Laranja", {25, 35}},     // Laranja varia de 20 a 30
-	{"Verde", {35, 85}},       // Verde varia de 45 a 85
-	{"Azul", {75, 135}},       // Azul varia de 75 a 135
-	{"Violeta", {135, 150}},   // Violeta varia de 135 a 150
-	{"Dourado", {25, 35}}      // Dourado varia de 20 a 30
+// A classificação só depende da saturação e do valor através dos limiares abaixo, pelo que estes são
+// quantizados em 3 níveis cada; o hue (0 a 179, o bin do histograma) entra inteiro, com uma coluna extra
+// (NHUES) para valores fora do intervalo
+const int NHUES = 180;
+constexpr int nivelSaturacao(int saturation) { return saturation < 20 ? 0 : (saturation < 100 ? 1 : 2); }
+constexpr int nivelValor(int value) { return value < 50 ? 0 : (value < 200 ? 1 : 2); }
+
+// Identifica a cor com base no valor HSV quantizado (nível de saturação, nível de valor, hue)
+constexpr Cor classificarCorHSV(int nivelS, int nivelV, int hue)
+{
+	if (nivelS == 0) // Considera cores achromáticas
+	{
+		return nivelV == 0 ? COR_PRETO : (nivelV == 1 ? COR_CINZENTO : COR_BRANCO);
+	}
+	if (hue >= 20 && hue <= 30)
+	{
+		// Distingue entre Dourado e Laranja baseado na saturação e valor
+		return (nivelS == 1 && nivelV < 2) ? COR_DOURADO : COR_LARANJA;
+	}
+	for (const FaixaHue& faixa : faixasHue)
+	{
+		if (hue >= faixa.min && hue <= faixa.max)
+			return faixa.cor;
+	}
+	// Se nenhuma cor for identificada
+	return COR_DESCONHECIDA;
+}
+
+// Cor de cada combinação (nível de saturação, nível de valor, hue), calculada na compilação
+struct TabelaCores
+{
+	unsigned char cor[3][3][NHUES + 1];
 };
 
+constexpr TabelaCores criarTabelaCores()
+{
+	TabelaCores tabela = {};
+	for (int s = 0; s < 3; s++)
+		for (int v = 0; v < 3; v++)
+			for (int h = 0; h <= NHUES; h++)
+				tabela.cor[s][v][h] = (unsigned char)classificarCorHSV(s, v, h);
+	return tabela;
+}
+
+constexpr TabelaCores tabelaCores = criarTabelaCores();
+
 // Identifica a cor com base no valor HSV
-// Hue é 0 a 255
-std::string identificarCorHSV(int hue, int saturation, int value) {
-	if (saturation < 20) { // Considera cores achromáticas
-		if (value < 50) return "Preto";
-		else if (value < 200) return "Cinzento";
-		else return "Branco";
-	} else {
-		if (hue >= 20 && hue <= 30) {
-			// Distingue entre Dourado e Laranja baseado na saturação e valor
-			if (saturation < 100 && value < 200) return "Dourado";
-			else return "Laranja";
-		} else {
-			for (const auto &color : HueColorMap) {
-				if (hue >= color.second.first && hue <= color.second.second) {
-					return color.first;
-				}
-			}
-		}
+// Hue é o bin do histograma (0 a 179); saturação e valor de 0 a 255
+Cor identificarCorHSV(int hue, int saturation, int value)
+{
+	return (Cor)tabelaCores.cor[nivelSaturacao(saturation)][nivelValor(value)][(unsigned)hue < (unsigned)NHUES ? hue : NHUES];
+}
+
+// Valor (ohms) e tolerância (%) de uma resistência a partir das cores das faixas, da esquerda para a direita
+// Com 3 faixas a tolerância é a do dourado (5 %). Devolve false se houver menos de 3 faixas ou se alguma
+// das cores não tiver significado na sua posição (p.ex. dourado como dígito)
+bool valorResistencia(const Cor* cores, int ncores, int& valor, int& tolerancia)
+{
+	if (ncores < 3)
+		return false;
+
+	int digit1 = valorCor[cores[0]];
+	int digit2 = valorCor[cores[1]];
+	float multiplier = multiplicadorCor[cores[2]];
+	tolerancia = (ncores >= 4) ? toleranciaCor[cores[3]] : toleranciaCor[COR_DOURADO];
+	if (digit1 < 0 || digit2 < 0 || multiplier == 0.0f || tolerancia == 0)
+		return false;
+
+	valor = (int)((digit1 * 10 + digit2) * multiplier);
+	return true;
+}
+
+// Resistência contada (uma entrada do relatório do modo sem interface)
+struct RegistoResistor
+{
+	int numero = 0;						// Ordem de contagem (1, 2, ...)
+	int nframe = 0;						// Frame em que o centro de massa passou na linha
+	int id = 0;							// Trajectória do blob (vc_tracker_update)
+	std::vector<Cor> cores;				// Cores das faixas, da esquerda para a direita
+	bool valido = false;				// false se não foram detectadas pelo menos 3 cores com valor nas suas posições
+	int valor = 0;						// Ohms
+	int tolerancia = 0;					// %
+};
+
+// Texto entre aspas para o relatório JSON
+std::string jsonTexto(const std::string& texto)
+{
+	std::string r = "\"";
+	for (char c : texto)
+	{
+		if (c == '"' || c == '\\') r += '\\';
+		if ((unsigned char)c < 0x20) r += ' ';
+		else r += c;
+	}
+	return r + "\"";
+}
+
+// Escreve o relatório do modo sem interface (JSON)
+bool escreverRelatorio(const std::string& ficheiro, const std::string& videofile, int nframes, double segundos, const std::vector<RegistoResistor>& registos)
+{
+	std::ofstream f(ficheiro);
+	if (!f)
+		return false;
+
+	int nvalidos = 0;
+	for (const auto& r : registos)
+		if (r.valido) nvalidos++;
+
+	f << "{\n";
+	f << "  \"video\": " << jsonTexto(videofile) << ",\n";
+	f << "  \"frames\": " << nframes << ",\n";
+	f << "  \"segundos\": " << segundos << ",\n";
+	f << "  \"fps\": " << (segundos > 0.0 ? nframes / segundos : 0.0) << ",\n";
+	f << "  \"resistencias\": [";
+	for (size_t i = 0; i < registos.size(); i++)
+	{
+		const RegistoResistor& r = registos[i];
+		f << (i == 0 ? "\n" : ",\n");
+		f << "    { \"numero\": " << r.numero << ", \"frame\": " << r.nframe << ", \"id\": " << r.id << ", \"cores\": [";
+		for (size_t c = 0; c < r.cores.size(); c++)
+			f << (c == 0 ? "" : ", ") << jsonTexto(nomesCores[r.cores[c]]);
+		f << "], ";
+		if (r.valido)
+			f << "\"valor\": " << r.valor << ", \"tolerancia\": " << r.tolerancia << " }";
+		else
+			f << "\"valor\": null, \"tolerancia\": null }";
+	}
+	f << (registos.empty() ? "],\n" : "\n  ],\n");
+	f << "  \"total\": " << registos.size() << ",\n";
+	f << "  \"total_com_valor\": " << nvalidos << "\n";
+	f << "}\n";
+
+	return (bool)f;
+}
+
+// Frame em curso no pipeline (slot do anel de frames pré-alocadas)
+struct SlotFrame
+{
+	cv::Mat frame;
+	IVC* imagem = nullptr;	// Vista IVC sobre frame (reutilizada enquanto o buffer do cv::Mat não mudar)
+	IVC* roi = nullptr;		// Vista sobre a faixa processada
+	int nframe = 0;
+	double tempos[NFASES];	// ms por fase (ver Instrumentacao)
+	bool ultima = false;	// Última frame a processar
+	bool fim = false;		// Não há frame: o vídeo terminou ou a aplicação vai sair
+};
+
+// Intervalo [x0, x1[ da linha y de uma frame
+struct SegmentoLinha
+{
+	int y, x0, x1;
+};
+
+// Converte para HSV (no próprio buffer) os segmentos de linha indicados; os que se sobrepõem na mesma linha
+// são unidos, para que nenhum pixel seja convertido duas vezes (a ordem dos segmentos é alterada)
+void converterSegmentosHSV(IVC* imagem, std::vector<SegmentoLinha>& segmentos)
+{
+	std::sort(segmentos.begin(), segmentos.end(), [](const SegmentoLinha& a, const SegmentoLinha& b)
+	{
+		return a.y < b.y || (a.y == b.y && a.x0 < b.x0);
+	});
+
+	for (size_t i = 0; i < segmentos.size();)
+	{
+		SegmentoLinha s = segmentos[i++];
+		while (i < segmentos.size() && segmentos[i].y == s.y && segmentos[i].x0 <= s.x1)
+			s.x1 = std::max(s.x1, segmentos[i++].x1);
+
+		IVC* linha = vc_image_roi(imagem, s.x0, s.y, s.x1 - s.x0, 1);
+		vc_rgb_to_hsv(linha);
+		vc_image_free(linha);
 	}
-	// Se nenhuma cor for identificada
-	return "Desconhecido";
 }
 
-int main(void)
+// Fila circular sem locks de índices de slots, com um produtor e um consumidor
+// N tem de ser pelo menos o número de índices em circulação (a fila nunca enche)
+template <int N>
+class FilaSPSC
+{
+public:
+	bool push(int valor)
+	{
+		size_t t = cauda.load(std::memory_order_relaxed);
+		if (t - cabeca.load(std::memory_order_acquire) == N)
+			return false;
+		buffer[t % N] = valor;
+		cauda.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(int& valor)
+	{
+		size_t h = cabeca.load(std::memory_order_relaxed);
+		if (h == cauda.load(std::memory_order_acquire))
+			return false;
+		valor = buffer[h % N];
+		cabeca.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Versões que esperam até a operação ser possível: primeiro cedem o processador e depois
+	// dormem, para não roubarem tempo às threads de vc.c enquanto a outra fase trabalha
+	void pushEspera(int valor)
+	{
+		for (int tentativas = 0; !push(valor); tentativas++)
+			espera(tentativas);
+	}
+
+	int popEspera(void)
+	{
+		int valor;
+		for (int tentativas = 0; !pop(valor); tentativas++)
+			espera(tentativas);
+		return valor;
+	}
+
+private:
+	static void espera(int tentativas)
+	{
+		if (tentativas < 64)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+
+	int buffer[N];
+	std::atomic<size_t> cabeca{ 0 };
+	std::atomic<size_t> cauda{ 0 };
+};
+
+int main(int argc, char* argv[])
 {
 	// Vídeo
 	// Meter o video no mesmo diretório que os ficheiros de cóodigo
-	char videofile[120] = "video_resistors.mp4";
+	std::string videofile = "video_resistors.mp4";
+	// Modo sem interface: VC-23-24 --headless <video> <relatorio.json>
+	// Sem janela nem texto fixo, processa todas as frames (sem parar na 780) e escreve o relatório no fim
+	bool headless = false;
+	std::string relatorio;
+	// --csv <ficheiro>: tempos de cada fase em cada frame (o resumo por fase é sempre mostrado no fim)
+	std::string ficheiroCSV;
+	// --escala <2|4>: segmentação, dilatação e etiquetagem numa versão reduzida da faixa (média de blocos escala x escala);
+	// a geometria dos blobs é aproximada e só a análise das cores usa a resolução original (1 = desligado)
+	int escala = 1;
+	for (int a = 1; a < argc; a++)
+	{
+		std::string arg = argv[a];
+
+		if (arg == "--headless" && a + 2 < argc)
+		{
+			headless = true;
+			videofile = argv[++a];
+			relatorio = argv[++a];
+		}
+		else if (arg == "--csv" && a + 1 < argc)
+		{
+			ficheiroCSV = argv[++a];
+		}
+		else if (arg == "--escala" && a + 1 < argc)
+		{
+			escala = std::atoi(argv[++a]);
+			if (escala != 1 && escala != 2 && escala != 4)
+			{
+				std::cerr << "Escala invalida (1, 2 ou 4): " << argv[a] << "\n";
+				return 1;
+			}
+		}
+		else if (arg[0] != '-' && a == 1)
+		{
+			videofile = arg;
+		}
+		else
+		{
+			std::cerr << "Uso: " << argv[0] << " [video | --headless <video> <relatorio.json>] [--csv <tempos.csv>] [--escala <1|2|4>]\n";
+			return 1;
+		}
+	}
 	cv::VideoCapture capture; // Objeto para captura de vídeo
 	struct
 	{
@@ -125,7 +471,6 @@ int main(void)
 		int nframe;
 	} video;
 	// Outros
-	std::string str;
 	int key = 0;
 
 	/* Leitura de vídeo de um ficheiro */
@@ -150,253 +495,502 @@ int main(void)
 	video.height = (int)capture.get(cv::CAP_PROP_FRAME_HEIGHT);
 
 	/* Cria uma janela para exibir o vídeo */
-	cv::namedWindow("VC - VIDEO", cv::WINDOW_GUI_NORMAL);
+	if (!headless)
+		cv::namedWindow("VC - VIDEO", cv::WINDOW_GUI_NORMAL);
 
 	/* Inicia o timer */
-	vc_timer();
-
-	// Declara a variável para armazenar a frame
-	cv::Mat frame;
+	vc_timer(!headless);
+
+	// Linha de contagem: um blob é contado quando o centro de massa está a menos de tolerance pixéis dela
+	const int altura = video.width / 2;
+	const int tolerance = 3;
+
+	// Tamanho do kernel da dilatação (na resolução original; com --escala é dividido pela escala)
+	// A dilatação é feita sobre máscaras de 1 bit por pixel (64 pixéis por palavra), com resultado igual ao de vc_binary_dilate;
+	// tal como o retângulo 48x48 do cv::dilate, a janela cobre [x - 24, x + 23]
+	const int kernelSize = 48;
+
+	// Modo ROI: segmentação, dilatação e etiquetagem só numa faixa horizontal à volta da linha de contagem.
+	// A faixa tem de conter qualquer blob que possa ser contado (centro a tolerance pixéis da linha e altura
+	// inferior a alturaMaximaBlob) mais o raio da dilatação, para que o resultado seja igual ao da frame inteira.
+	const bool modoROI = true;
+	const int alturaMaximaBlob = 130;
+	const int margemROI = tolerance + alturaMaximaBlob + kernelSize / 2;
+	int roiY0 = 0, roiAltura = video.height;
+	if (modoROI)
+	{
+		roiY0 = std::max(0, std::min(altura - margemROI, video.height - 1));
+		roiAltura = std::min(video.height, altura + margemROI + 1) - roiY0;
+		if (roiAltura <= 0)
+		{
+			roiY0 = 0;
+			roiAltura = video.height;
+		}
+	}
 
-	// Cria novas imagens IVC
-	IVC* image = vc_image_new(video.width, video.height, 3, 255);
-	IVC* image2 = vc_image_new(video.width, video.height, 1, 255);
-	IVC* imagemDilatada = vc_image_new(video.width, video.height, 1, 255);
-	IVC* imagemEtiquetada = vc_image_new(video.width, video.height, 1, 255);
-	IVC* imagemHSV = vc_image_new(video.width, video.height, 3, 255);
+	// Cria novas imagens IVC com a altura da faixa processada
+	// (a frame em si não é copiada: é usada através de uma vista, vc_image_wrap)
+	// (linhas alinhadas a 64 bytes)
+	// Com escala > 1 a máscara, a dilatação e a etiquetagem são feitas sobre faixaReduzida (largura e altura divididas
+	// pela escala: 4x / 16x menos pixéis) e os blobs são depois levados para as coordenadas da frame
+	const int larguraAnalise = video.width / escala;
+	const int alturaAnalise = roiAltura / escala;
+	const int kernelAnalise = std::max(1, kernelSize / escala);
+	IVC* faixaReduzida = (escala > 1) ? vc_image_new_aligned(larguraAnalise, alturaAnalise, 3, 255, 0) : nullptr;
+	IVC* image2 = vc_image_new_aligned(larguraAnalise, alturaAnalise, 1, 255, 0);
+	BVC* mascara = vc_mask_new(larguraAnalise, alturaAnalise);
+	RLEVC* corridas = vc_rle_new(larguraAnalise, alturaAnalise);
+
+	// Seguimento dos blobs entre frames (identificadores persistentes e um evento de contagem por trajectória)
+	// Um blob é associado à trajectória cuja posição prevista toca a sua caixa ou está a menos de alturaMaximaBlob pixéis
+	const int maxTrajectorias = 64;
+	const int maxFramesPerdidas = 5;
+	TRACKVC* tracker = vc_tracker_new(maxTrajectorias, altura, tolerance, alturaMaximaBlob, maxFramesPerdidas);
+
+	// Análise das cores: número de linhas (centradas no centro de massa) lidas em cada resistência contada.
+	// Com mais linhas o hue dominante e as médias são menos sensíveis a uma linha com reflexos ou com a cruz do centro de massa
+	const int linhasCor = 1;
+
+	// Porta de movimento: a faixa é comparada (1 pixel em cada passoMovimento x passoMovimento) com a última
+	// frame analisada em que não havia blobs. Se nenhuma amostra mudou mais do que limiarMovimento num canal e
+	// nenhuma está dentro da segmentação HSV (as mesmas amostras, na faixa reduzida com escala > 1), a dilatação,
+	// etiquetagem e seguimento são saltados. A porta é aproximada: só vê os blobs que cobrem alguma amostra, o que
+	// qualquer resistência (mais de 85 pixéis de altura, sem buracos de passoMovimento pixéis) faz; um blob feito só
+	// de linhas finas entre as amostras seria perdido. A referência só é substituída por frames analisadas sem
+	// blobs, pelo que uma mudança lenta acaba sempre por ser detectada. Com janela, a faixa continua a ser
+	// convertida para HSV (é o que é mostrado).
+	const bool portaMovimento = true;
+	const int passoMovimento = 4;
+	const int limiarMovimento = 24;
+	const int passoAmostras = std::max(1, passoMovimento / escala);	// Passo das amostras da segmentação
+	IVC* referencia = vc_image_new((video.width + passoMovimento - 1) / passoMovimento, (roiAltura + passoMovimento - 1) / passoMovimento, 3, 255);
+	IVC* candidata = vc_image_new(referencia->width, referencia->height, 3, 255);
+	bool referenciaValida = false;
+	int nframesSaltadas = 0;
 
 	int resistorsCounter = 0;
 	int* resistencia = nullptr;
-
-	while (key != 'q')
+	std::vector<RegistoResistor> registos;	// Só a thread de análise escreve; lido depois do join
+	int nframesProcessadas = 0;
+	Instrumentacao instrumentacao;
+	instrumentacao.reservar(headless ? video.ntotalframes : std::min(video.ntotalframes, 780));
+
+	// Pipeline em três fases: leitura (descodificação) -> análise -> apresentação, cada uma na sua thread.
+	// As fases passam entre si índices de um anel de NSLOTS frames pré-alocadas, através de filas sem locks
+	// (um produtor e um consumidor cada). Um slot só volta à leitura depois de apresentado, pelo que nunca há
+	// mais de NSLOTS frames em curso (back-pressure), e as filas mantêm a ordem das frames.
+	const int NSLOTS = 4;
+	SlotFrame slots[NSLOTS];
+	FilaSPSC<NSLOTS> livres, lidas, analisadas;
+	std::atomic<bool> parar(false);
+
+	for (int i = 0; i < NSLOTS; i++)
 	{
-		/* Leitura de uma frame do vídeo */
-		capture.read(frame);
-
-		/* Verifica se conseguiu ler a frame */
-		if (frame.empty())
-			break;
-
-		/* Número da frame a processar */
-		video.nframe = (int)capture.get(cv::CAP_PROP_POS_FRAMES);
-
-		/* Exemplo de inserção texto na frame */
-		str = std::string("RESOLUCAO: ").append(std::to_string(video.width)).append("x").append(std::to_string(video.height));
-		cv::putText(frame, str, cv::Point(20, 25), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 0, 0), 2);
-		cv::putText(frame, str, cv::Point(20, 25), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(255, 255, 255), 1);
-		str = std::string("TOTAL DE FRAMES: ").append(std::to_string(video.ntotalframes));
-		cv::putText(frame, str, cv::Point(20, 50), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 0, 0), 2);
-		cv::putText(frame, str, cv::Point(20, 50), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(255, 255, 255), 1);
-		str = std::string("FRAME RATE: ").append(std::to_string(video.fps));
-		cv::putText(frame, str, cv::Point(20, 75), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 0, 0), 2);
-		cv::putText(frame, str, cv::Point(20, 75), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(255, 255, 255), 1);
-		str = std::string("N. DA FRAME: ").append(std::to_string(video.nframe));
-		cv::putText(frame, str, cv::Point(20, 100), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 0, 0), 2);
-		cv::putText(frame, str, cv::Point(20, 100), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(255, 255, 255), 1);
-
-
-		std::string str = "Valor do resistor " + std::to_string(resistorsCounter) + ": " + std::to_string(resistencia == nullptr ? 0 : *resistencia) + " ohms";
-		cv::putText(frame, str, cv::Point(20, 900), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 0, 0), 2);
-		cv::putText(frame, str, cv::Point(20, 900), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(255, 255, 255), 1);
-
-		// Copia dados de imagem da estrutura cv::Mat para uma estrutura IVC
-		memcpy(image->data, frame.data, video.width * video.height * 3);
-
-		// Converte imagem RGB para HSV
-		vc_rgb_to_hsv(image);
-
-		// Copia imagem HSV
-		memcpy(imagemHSV->data, image->data, video.width * video.height * 3);
+		slots[i].frame.create(video.height, video.width, CV_8UC3);
+		livres.push(i);
+	}
 
-		// Segmentação da imagem HSV
-		vc_hsv_segmentation(image, 0, 200, 40, 60, 40, 75);
+	Relogio::time_point inicio = Relogio::now();
 
+	// Fase 1: leitura das frames e texto fixo (desenhado antes da análise, como na versão sequencial)
+	// Os textos que não mudam são criados uma só vez; str reutiliza a sua memória de frame para frame
+	std::thread leitura([&]()
+	{
+		const std::string strResolucao = std::string("RESOLUCAO: ").append(std::to_string(video.width)).append("x").append(std::to_string(video.height));
+		const std::string strTotal = std::string("TOTAL DE FRAMES: ").append(std::to_string(video.ntotalframes));
+		const std::string strFps = std::string("FRAME RATE: ").append(std::to_string(video.fps));
+		std::string str;
+		bool terminar = false;
 
-		// Tranforma imagem HSV em imagem binária
-		vc_3channels_to_1(image, image2);
+		while (!terminar)
+		{
+			int i = livres.popEspera();
+			SlotFrame& slot = slots[i];
 
-		// Faz a dilatação da imagem binária
-		// Converte IVC para cv::Mat
-		cv::Mat matImagemBinaria(video.height, video.width, CV_8UC1, image2->data);
-		cv::Mat matDilatada;
+			for (int f = 0; f < NFASES; f++)
+				slot.tempos[f] = -1.0;
 
-		// Cria kernel
-		int kernelSize = 48;
+			/* Leitura de uma frame do vídeo (verifica se conseguiu ler a frame) */
+			Relogio::time_point t = Relogio::now();
+			slot.fim = parar.load() || !capture.read(slot.frame) || slot.frame.empty();
+			slot.tempos[FASE_LEITURA] = msDesde(t);
+			slot.ultima = false;
 
-		cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(kernelSize, kernelSize));
+			if (!slot.fim)
+			{
+				/* Número da frame a processar */
+				slot.nframe = (int)capture.get(cv::CAP_PROP_POS_FRAMES);
+			}
 
-		cv::dilate(matImagemBinaria, matDilatada, kernel);
+			// Texto fixo e paragem na frame 780 só no modo com janela
+			if (!slot.fim && !headless)
+			{
+				/* Exemplo de inserção texto na frame */
+				cv::putText(slot.frame, strResolucao, cv::Point(20, 25), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 0, 0), 2);
+				cv::putText(slot.frame, strResolucao, cv::Point(20, 25), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(255, 255, 255), 1);
+				cv::putText(slot.frame, strTotal, cv::Point(20, 50), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 0, 0), 2);
+				cv::putText(slot.frame, strTotal, cv::Point(20, 50), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(255, 255, 255), 1);
+				cv::putText(slot.frame, strFps, cv::Point(20, 75), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 0, 0), 2);
+				cv::putText(slot.frame, strFps, cv::Point(20, 75), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(255, 255, 255), 1);
+				str.assign("N. DA FRAME: ").append(std::to_string(slot.nframe));
+				cv::putText(slot.frame, str, cv::Point(20, 100), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 0, 0), 2);
+				cv::putText(slot.frame, str, cv::Point(20, 100), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(255, 255, 255), 1);
+
+				// Interrompe a execução após o frame 780
+				slot.ultima = (slot.nframe == 780);
+			}
 
-		// Converte de volta para IVC
-		memcpy(imagemDilatada->data, matDilatada.data, video.width * video.height);
+			terminar = slot.fim || slot.ultima;
+			lidas.pushEspera(i);
+		}
+	});
 
-		// Etiquetagem dos blobs
-		int nblobs;
-		OVC* blobs = vc_binary_blob_labelling(imagemDilatada, imagemEtiquetada, &nblobs);
+	// Fase 2: análise (segmentação, blobs, contagem e cores)
+	// Em regime estável não aloca memória: as vistas IVC ficam no slot, os buffers temporários de vc.c vêm
+	// da reserva (vc_scratch_borrow) e str / listaBlobs / blobCortado / qualifica / ids / eventos / segmentosHSV reutilizam a sua capacidade
+	std::thread analise([&]()
+	{
+		std::string str;
+		std::vector<bool> blobCortado;
+		std::vector<OVC> listaBlobs(64);
+		std::vector<int> qualifica, ids, eventos;
+		std::vector<SegmentoLinha> segmentosHSV;
+		int ultimaFrame = -1;
+		bool terminar = false;
+
+		while (!terminar)
+		{
+			int i = lidas.popEspera();
+			SlotFrame& slot = slots[i];
 
-		// Extração de informação dos blobs
-		vc_binary_blob_info(imagemEtiquetada, blobs, nblobs);
+			terminar = slot.fim || slot.ultima;
+			if (slot.fim)
+			{
+				analisadas.pushEspera(i);
+				continue;
+			}
+			nframesProcessadas++;
+
+			// Este texto e as marcações do blob ficam também no modo sem interface: são desenhados na frame antes
+			// da leitura das cores (a linha 900 e o centro de massa estão dentro da faixa analisada), pelo que
+			// retirá-los mudaria os valores do relatório em relação à execução com janela
+			str.assign("Valor do resistor ").append(std::to_string(resistorsCounter)).append(": ").append(std::to_string(resistencia == nullptr ? 0 : *resistencia)).append(" ohms");
+			cv::putText(slot.frame, str, cv::Point(20, 900), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 0, 0), 2);
+			cv::putText(slot.frame, str, cv::Point(20, 900), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(255, 255, 255), 1);
+
+			// Vista IVC sobre os dados da frame (sem cópia; respeita o stride do cv::Mat) e sobre a faixa processada
+			// Só são recriadas se o cv::Mat tiver mudado de buffer (p.ex. uma frame com outro tamanho)
+			if (slot.imagem == nullptr || slot.imagem->data != slot.frame.data || slot.imagem->bytesperline != (int)slot.frame.step ||
+				slot.imagem->width != slot.frame.cols || slot.imagem->height != slot.frame.rows)
+			{
+				vc_image_free(slot.roi);
+				vc_image_free(slot.imagem);
+				slot.imagem = vc_image_wrap(slot.frame.data, slot.frame.cols, slot.frame.rows, 3, 255, (int)slot.frame.step);
+				slot.roi = vc_image_roi(slot.imagem, 0, roiY0, video.width, roiAltura);
+			}
+			IVC* imagemFrame = slot.imagem;
+			IVC* imagemROI = slot.roi;
+
+			// Porta de movimento (antes da conversão para HSV, que altera a faixa)
+			// Com escala > 1 as amostras da segmentação são lidas na faixa reduzida, que já fica feita
+			Relogio::time_point t = Relogio::now();
+			bool reduzida = false;
+			if (portaMovimento)
+			{
+				bool semMudanca = referenciaValida && vc_motion_score(imagemROI, referencia, passoMovimento, limiarMovimento) == 0;
+				if (semMudanca && escala > 1)
+				{
+					vc_image_downsample(imagemROI, faixaReduzida, escala);
+					reduzida = true;
+				}
+				if (semMudanca && vc_motion_hsv_count(reduzida ? faixaReduzida : imagemROI, reduzida ? passoAmostras : passoMovimento, 0, 141, 102, 153, 102, 191) == 0)
+				{
+					if (!headless)
+						vc_rgb_to_hsv(imagemROI);
+					slot.tempos[FASE_MOVIMENTO] = msDesde(t);
+					nframesSaltadas++;
 
-		// Converte IVC para cv::Mat
-		cv::Mat hsvImage(image->height, image->width, CV_8UC3, imagemHSV->data);
+					analisadas.pushEspera(i);
+					continue;
+				}
+				vc_motion_update(imagemROI, candidata, passoMovimento);
+				slot.tempos[FASE_MOVIMENTO] = msDesde(t);
+			}
 
-		//Bounding box e identificação de resistências
-		if (blobs != nullptr)
-		{
-			int altura = video.width / 2;
-			const int tolerance = 3;
+			// Converte a faixa para HSV (no próprio buffer) e segmenta numa só passagem (máscara em image2)
+			// Intervalos nas unidades nativas [0,255]: H 0-200 graus, S 40-60 %, V 40-75 %
+			// Com escala > 1 segmenta a faixa reduzida; a faixa original só é convertida para HSV com janela
+			// (é o que é mostrado), senão apenas os segmentos de linha lidos na análise das cores o são
+			t = Relogio::now();
+			if (escala > 1)
+			{
+				if (!reduzida)
+					vc_image_downsample(imagemROI, faixaReduzida, escala);
+				vc_rgb_to_hsv_segmentation(faixaReduzida, faixaReduzida, image2, 0, 141, 102, 153, 102, 191);
+				if (!headless)
+					vc_rgb_to_hsv(imagemROI);
+			}
+			else
+			{
+				vc_rgb_to_hsv_segmentation(imagemROI, imagemROI, image2, 0, 141, 102, 153, 102, 191);
+			}
+			slot.tempos[FASE_HSV_SEGMENTACAO] = msDesde(t);
+
+			// Faz a dilatação da imagem binária (convertida para máscara de bits)
+			t = Relogio::now();
+			vc_mask_from_binary(image2, mascara);
+			vc_mask_dilate(mascara, mascara, kernelAnalise);
+			slot.tempos[FASE_DILATACAO] = msDesde(t);
+
+			// Etiquetagem dos blobs e extração de informação dos blobs (numa só passagem)
+			// sobre as corridas de cada linha da máscara, em vez de pixel a pixel
+			// Os blobs são escritos em listaBlobs, que só cresce se a frame tiver mais blobs do que cabem nela
+			t = Relogio::now();
+			vc_rle_from_mask(mascara, corridas);
+			int nblobs = vc_rle_blob_labelling_into(corridas, listaBlobs.data(), (int)listaBlobs.size());
+			if (nblobs > (int)listaBlobs.size())
+			{
+				listaBlobs.resize(nblobs);
+				nblobs = vc_rle_blob_labelling_into(corridas, listaBlobs.data(), (int)listaBlobs.size());
+			}
+			nblobs = std::max(nblobs, 0);
+			OVC* blobs = listaBlobs.data();
+			slot.tempos[FASE_ETIQUETAGEM] = msDesde(t);
+
+			// Uma frame sem blobs passa a ser a referência da porta de movimento
+			referenciaValida = (nblobs == 0);
+			if (referenciaValida)
+				std::swap(referencia, candidata);
+
+			// Coordenadas dos blobs na frame inteira
+			// Um blob que toca o limite da faixa (onde este não é o limite da frame) pode estar cortado e não é contado;
+			// a etiquetagem trata a primeira e a última linha como fundo, pelo que o limite é a linha 1 / alturaAnalise - 2
+			// Com escala > 1 cada pixel da máscara é um bloco escala x escala da frame: caixa, área e perímetro são
+			// multiplicados e o centro de massa passa para o centro do bloco (os limiares de ehResistencia ficam aproximados)
+			blobCortado.assign(nblobs, false);
+			for (int i = 0; i < nblobs; i++)
+			{
+				blobCortado[i] = (roiY0 > 0 && blobs[i].y <= 1) || (roiY0 + roiAltura < video.height && blobs[i].y + blobs[i].height >= alturaAnalise - 1);
+				if (escala > 1)
+				{
+					blobs[i].x *= escala;
+					blobs[i].y *= escala;
+					blobs[i].width *= escala;
+					blobs[i].height *= escala;
+					blobs[i].xc = blobs[i].xc * escala + escala / 2;
+					blobs[i].yc = blobs[i].yc * escala + escala / 2;
+					blobs[i].area *= escala * escala;
+					blobs[i].perimeter *= escala;
+				}
+				blobs[i].y += roiY0;
+				blobs[i].yc += roiY0;
+			}
 
 			// Verifica se o blob é uma resistência
-			if (blobs->area > 15000 && blobs->area < 28000 && blobs->perimeter > 500 && blobs->perimeter < 700 && blobs->height < 130 && blobs->height > 85)
+			auto ehResistencia = [&](int b)
+			{
+				return !blobCortado[b] && blobs[b].area > 15000 && blobs[b].area < 28000 && blobs[b].perimeter > 500 && blobs[b].perimeter < 700 && blobs[b].height < 130 && blobs[b].height > 85;
+			};
+
+			// Seguimento: associa os blobs às trajectórias das frames anteriores; cada trajectória gera um único
+			// evento quando o centro de massa passa pela linha de contagem (mesmo que a salte entre duas frames)
+			// e o blob é uma resistência; se não for, o evento fica pendente enquanto o centro estiver na tolerância
+			qualifica.resize(nblobs);
+			for (int b = 0; b < nblobs; b++)
+				qualifica[b] = ehResistencia(b);
+			ids.resize(nblobs);
+			eventos.resize(nblobs);
+			int neventos = vc_tracker_update(tracker, blobs, nblobs, ultimaFrame < 0 ? 1 : std::max(1, slot.nframe - ultimaFrame), qualifica.data(), ids.data(), eventos.data());
+			neventos = std::max(neventos, 0);
+			ultimaFrame = slot.nframe;
+
+			// Linhas e colunas lidas na análise das cores de um blob: a linha do centro de massa (ou linhasCor
+			// linhas centradas nela), dentro da largura do blob
+			auto segmentoCor = [&](const OVC* blob, int& y0, int& nlinhas, int& startX, int& endX)
 			{
-				// Desenha as bounding boxes e cruzes no centro de massa
-				vc_draw_boundingbox(imagemHSV, blobs);
-				vc_draw_center_of_mass(imagemHSV, blobs, nblobs, 10, 255);
+				y0 = std::max(0, std::min(blob->yc - linhasCor / 2, video.height - linhasCor));
+				nlinhas = std::min(linhasCor, video.height);
+				startX = std::max(0, blob->xc - blob->width / 2);
+				endX = std::min(video.width - 1, blob->xc + blob->width / 2);
+			};
+
+			// Com escala > 1 e sem janela a faixa original não foi convertida para HSV: converte já as linhas
+			// lidas na análise das cores das resistências contadas nesta frame, antes de desenhar as marcações
+			// (a cruz do centro de massa cai sobre elas), para que as cores sejam as da execução com janela
+			if (escala > 1 && headless && neventos > 0)
+			{
+				t = Relogio::now();
+				segmentosHSV.clear();
+				for (int e = 0; e < neventos; e++)
+				{
+					int y0, nlinhas, startX, endX;
+					segmentoCor(&blobs[eventos[e]], y0, nlinhas, startX, endX);
+					for (int y = y0; y < y0 + nlinhas && endX > startX; y++)
+						segmentosHSV.push_back({ y, startX, endX });
+				}
+				converterSegmentosHSV(imagemFrame, segmentosHSV);
+				slot.tempos[FASE_CORES] = msDesde(t);
+			}
 
-				// Quando o centro de massa passa pelo centro da tela, conta um blob como resistência
-				if (abs(blobs->yc - altura) <= tolerance)
+			//Bounding box das resistências
+			for (int b = 0; b < nblobs; b++)
+			{
+				if (qualifica[b])
 				{
-					resistorsCounter++;
-
-					// Identifica todas as cores na linha do centro de massa dentro do blob
-					// Acessa a linha do centro de massa
-					cv::Mat linha = hsvImage.row(blobs->yc);
-
-					// Delimita a área do blob na linha
-					int startX = std::max(0, blobs->xc - blobs->width / 2);
-					int endX = std::min(linha.cols - 1, blobs->xc + blobs->width / 2);
-					cv::Mat linhaBlob = linha(cv::Range::all(), cv::Range(startX, endX));
-
-					// Separa os canais HSV
-					std::vector<cv::Mat> hsvChannels;
-					cv::split(linhaBlob, hsvChannels);
-
-					int segmentSize = linhaBlob.cols / 4; // Tamanho do segmento
-					std::vector<std::string> coresResistor;
-
-					// Itera sobre os segmentos da linha
-					for (int i = 0; i < linhaBlob.cols; i += segmentSize)
-					{
-						// Recorta o segmento
-						cv::Rect roi(i, 0, std::min(segmentSize, linhaBlob.cols - i), 1);
-						cv::Mat segment = linhaBlob(roi);
-
-						// Separa os canais HSV dentro do segmento
-						std::vector<cv::Mat> segmentChannels;
-						cv::split(segment, segmentChannels);
-
-						// Calcula o histograma do canal H (Hue)
-						int histSize = 180;
-						float range[] = { 0, 180 };
-						const float* histRange = { range };
-						cv::Mat hist;
-						cv::calcHist(&segmentChannels[0], 1, 0, cv::Mat(), hist, 1, &histSize, &histRange);
-
-						// Encontra o bin com o maior valor no histograma
-						cv::Point maxLoc;
-						cv::minMaxLoc(hist, 0, 0, 0, &maxLoc);
-						int hue = maxLoc.y;
-
-						// Calcula a média de saturação e valor
-						int saturation = cv::mean(segmentChannels[1])[0];
-						int value = cv::mean(segmentChannels[2])[0];
-
-						// Identifica a cor dominante
-						std::string corDominante = identificarCorHSV(hue, saturation, value);
-						// Adiciona a cor à lista
-						coresResistor.push_back(corDominante);
-					}
+					// Desenha a bounding box e a cruz no centro de massa
+					vc_draw_boundingbox(imagemFrame, &blobs[b]);
+					vc_draw_center_of_mass(imagemFrame, &blobs[b], 1, 10, 255);
+				}
+			}
 
-					// Exibe as cores na ordem
-					for (const auto& cor : coresResistor) {
-						std::cout << "Cor: " << cor << std::endl;
-					}
+			// Conta as resistências cujas trajectórias passaram agora pela linha de contagem
+			for (int e = 0; e < neventos; e++)
+			{
+				OVC* blob = &blobs[eventos[e]];
+				resistorsCounter++;
+				t = Relogio::now();
+
+				// Identifica todas as cores na linha do centro de massa dentro do blob
+				// (ou em linhasCor linhas centradas nela), numa só passagem em vc_hsv_band_profile
+				int y0, nlinhas, startX, endX;
+				segmentoCor(blob, y0, nlinhas, startX, endX);
+
+				// Segmentos de um quarto da largura (o último pode ser mais curto): hue dominante (histograma
+				// de 180 bins) e médias de saturação e valor de cada um
+				int segmentSize = std::max(1, (endX - startX) / 4); // Tamanho do segmento
+				// Com segmentos de cols / 4 pixéis há no máximo 7 (cols = 7), mais um de folga
+				const int maxFaixas = 8;
+				int hues[maxFaixas], saturacoes[maxFaixas], valores[maxFaixas];
+				Cor coresResistor[maxFaixas];
+				int ncores = vc_hsv_band_profile(imagemFrame, startX, y0, endX - startX, nlinhas, segmentSize, hues, saturacoes, valores, maxFaixas);
+
+				// Identifica a cor dominante de cada segmento
+				for (int c = 0; c < ncores; c++)
+					coresResistor[c] = identificarCorHSV(hues[c], saturacoes[c], valores[c]);
+				slot.tempos[FASE_CORES] = std::max(slot.tempos[FASE_CORES], 0.0) + msDesde(t);
+
+				RegistoResistor registo;
+				registo.numero = resistorsCounter;
+				registo.nframe = slot.nframe;
+				registo.id = ids[eventos[e]];
+				registo.cores.assign(coresResistor, coresResistor + ncores);
+
+				// Exibe as cores na ordem
+				for (int c = 0; c < ncores; c++) {
+					std::cout << "Cor: " << nomesCores[coresResistor[c]] << std::endl;
+				}
 
-					// Verifica se 4 cores foram detectadas
-					if (coresResistor.size() >= 4) {
-						// Calcula o valor da resistência
-						int digit1 = colorValueMap[coresResistor[0]];
-						int digit2 = colorValueMap[coresResistor[1]];
-						int multiplier = multiplierMap[coresResistor[2]];
-						int tolerancia = toleranceMap[coresResistor[3]];
-
-						// Calcula o novo valor da resistência
-						int novoValorResistencia = (digit1 * 10 + digit2) * multiplier;
-
-						// Se o ponteiro para a resistência ainda for nulo, atribua o novo valor da resistência a ele
-						if (resistencia == nullptr) {
-							resistencia = new int(novoValorResistencia);
-						}
-						else {
-							// Caso contrário, atualize o valor da resistência
-							*resistencia = novoValorResistencia;
-						}
-						std::cout << "Valor da resistência: " << *resistencia << " ohms" << std::endl;
-						std::cout << "Tolerância: ±" << tolerancia << "%" << std::endl;
-					}
-					else if (coresResistor.size() == 3) {
-						// Calcula o valor da resistência
-						int digit1 = colorValueMap[coresResistor[0]];
-						int digit2 = colorValueMap[coresResistor[1]];
-						int multiplier = multiplierMap[coresResistor[2]];
-						int tolerancia = 5.0; //Dourado
-
-						// Calcula o novo valor da resistência
-						int novoValorResistencia = (digit1 * 10 + digit2) * multiplier;
-
-						// Se o ponteiro para a resistência ainda for nulo, atribua o novo valor da resistência a ele
-						if (resistencia == nullptr) {
-							resistencia = new int(novoValorResistencia);
-						}
-						else {
-							// Caso contrário, atualize o valor da resistência
-							*resistencia = novoValorResistencia;
-						}
-						std::cout << "Valor da resistência: " << resistencia << " ohms" << std::endl;
-						std::cout << "Tolerância: ±" << tolerancia << "%" << std::endl;
+				// Calcula o valor da resistência (com 3 cores a tolerância é a do dourado)
+				int novoValorResistencia, tolerancia;
+				if (valorResistencia(coresResistor, ncores, novoValorResistencia, tolerancia)) {
+					// Se o ponteiro para a resistência ainda for nulo, atribua o novo valor da resistência a ele
+					if (resistencia == nullptr) {
+						resistencia = new int(novoValorResistencia);
 					}
 					else {
-						std::cout << "Erro: Não foram detectadas 4 cores." << std::endl;
+						// Caso contrário, atualize o valor da resistência
+						*resistencia = novoValorResistencia;
 					}
+					std::cout << "Valor da resistência: " << *resistencia << " ohms" << std::endl;
+					std::cout << "Tolerância: ±" << tolerancia << "%" << std::endl;
+
+					registo.valido = true;
+					registo.valor = novoValorResistencia;
+					registo.tolerancia = tolerancia;
+				}
+				else if (ncores < 3) {
+					std::cout << "Erro: Não foram detectadas 4 cores." << std::endl;
+				}
+				else {
+					std::cout << "Erro: cores sem valor nas posições de dígito, multiplicador ou tolerância." << std::endl;
 				}
+
+				registos.push_back(registo);
 			}
+
+			analisadas.pushEspera(i);
 		}
+	});
 
-		//  Copia dados de imagem da estrutura IVC para uma estrutura cv::Mat
-		memcpy(frame.data, imagemHSV->data, video.width * video.height * 3);
+	// Fase 3: apresentação, na thread principal (a que criou a janela)
+	for (;;)
+	{
+		int i = analisadas.popEspera();
+		SlotFrame& slot = slots[i];
+		bool terminar = slot.fim || slot.ultima;
 
-		/* Exibe a frame */
-		cv::imshow("VC - VIDEO", frame);
+		if (!slot.fim && !parar.load() && !headless)
+		{
+			Relogio::time_point t = Relogio::now();
 
-		/* Sai da aplicação, se o utilizador premir a tecla 'q' */
-		key = cv::waitKey(1);
+			/* Exibe a frame */
+			cv::imshow("VC - VIDEO", slot.frame);
 
-		// Interrompe a execução após o frame 780
-		if (video.nframe == 780)
-		{
-			break;
+			/* Sai da aplicação, se o utilizador premir a tecla 'q' (as frames já lidas são descartadas) */
+			key = cv::waitKey(1);
+			if (key == 'q')
+				parar = true;
+
+			slot.tempos[FASE_APRESENTACAO] = msDesde(t);
 		}
 
+		if (!slot.fim)
+			instrumentacao.registar(slot.nframe, slot.tempos);
+
+		livres.pushEspera(i);
+
+		if (terminar)
+			break;
 	}
 
+	leitura.join();
+	analise.join();
+
 	std::cout << "Numero de resistencias: " << resistorsCounter << std::endl;
+	if (portaMovimento)
+		std::cout << "Frames sem movimento (analise saltada): " << nframesSaltadas << " de " << nframesProcessadas << std::endl;
+
+	/* Tempos por fase */
+	instrumentacao.resumo(std::cout, msDesde(inicio) / 1000.0);
+	if (!ficheiroCSV.empty() && !instrumentacao.escreverCSV(ficheiroCSV))
+		std::cerr << "Erro ao escrever o ficheiro " << ficheiroCSV << "!\n";
 
 	/* Para o timer e exibe o tempo decorrido */
-	vc_timer();
+	double segundos = vc_timer(!headless);
+	int estado = 0;
 
-	/* Fecha a janela */
-	cv::destroyWindow("VC - VIDEO");
+	if (headless)
+	{
+		if (!escreverRelatorio(relatorio, videofile, nframesProcessadas, segundos, registos))
+		{
+			std::cerr << "Erro ao escrever o relatório " << relatorio << "!\n";
+			estado = 1;
+		}
+	}
+	else
+	{
+		/* Fecha a janela */
+		cv::destroyWindow("VC - VIDEO");
+	}
 
 	/* Fecha o ficheiro de vídeo */
 	capture.release();
 
-	// Liberta a memória da imagem IVC que havia sido criada
-	vc_image_free(image);
+	// Liberta a memória da imagem IVC que havia sido criada e as vistas dos slots
+	vc_image_free(faixaReduzida);
 	vc_image_free(image2);
-	vc_image_free(imagemDilatada);
-	vc_image_free(imagemEtiquetada);
-	vc_image_free(imagemHSV);
+	vc_mask_free(mascara);
+	vc_rle_free(corridas);
+	vc_tracker_free(tracker);
+	vc_image_free(referencia);
+	vc_image_free(candidata);
+	for (int i = 0; i < NSLOTS; i++)
+	{
+		vc_image_free(slots[i].roi);
+		vc_image_free(slots[i].imagem);
+	}
+	vc_scratch_clear();
 
 
-	return 0;
+	return estado;
 }
\ No newline at end of file
@@ -0,0 +1,660 @@
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//           MICROBENCHMARKS DAS FUNÇÕES DE vc.h
+//
+// Mede cada função pública sobre imagens sintéticas (VGA, 720p,
+// 1080p e 4K), vários tamanhos de kernel e densidades de blobs.
+// Resultados em ns/pixel (mínimo e mediana) e MB/s (bytes lidos
+// e escritos por pixel / tempo mediano).
+//
+// Uso: vc_bench [--csv] [--res vga,720p,1080p,4k] [--kernels 3,7,15,31]
+//               [--densidades 10,100,1000] [--funcao nome] [--threads n]
+//               [--min-ms t]
+//
+// --csv: uma linha por medição, para comparar execuções entre commits
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "vc.h"
+
+
+#define MAX_LISTA 16
+#define BENCH_FLUXO 16			// Blobs do fluxo sintético de vc_tracker_*
+#define MAX_REPETICOES 1000
+#define FICHEIRO_PPM "vc_bench_tmp.ppm"
+
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//                  RELÓGIO E IMAGENS SINTÉTICAS
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Tempo monotónico em nanossegundos
+static double bench_ns(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER t;
+
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t);
+
+	return (double)t.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+#endif
+}
+
+// Gerador pseudo-aleatório determinístico (as imagens são iguais em todas as execuções)
+static unsigned int bench_aleatorio(unsigned int* estado)
+{
+	*estado = *estado * 1103515245u + 12345u;
+
+	return (*estado >> 16) & 0x7fff;
+}
+
+// Imagem a cores: gradientes com ruído (cena) e blobs rectangulares com a cor das resistências
+static void bench_gerar_rgb(IVC* rgb, IVC* bin)
+{
+	unsigned int estado = 1;
+	int x, y;
+	long int pos;
+
+	for (y = 0; y < rgb->height; y++)
+	{
+		for (x = 0; x < rgb->width; x++)
+		{
+			pos = y * rgb->bytesperline + x * 3;
+
+			if (bin->data[y * bin->bytesperline + x])
+			{
+				rgb->data[pos] = 150;
+				rgb->data[pos + 1] = 100;
+				rgb->data[pos + 2] = 80;
+			}
+			else
+			{
+				rgb->data[pos] = (unsigned char)((x * 255 / rgb->width + bench_aleatorio(&estado) % 32) & 0xff);
+				rgb->data[pos + 1] = (unsigned char)((y * 255 / rgb->height + bench_aleatorio(&estado) % 32) & 0xff);
+				rgb->data[pos + 2] = (unsigned char)(bench_aleatorio(&estado) & 0xff);
+			}
+		}
+	}
+}
+
+// Imagem binária (0/255) com cerca de densidade blobs por megapixel, numa grelha com posições aleatórias
+static int bench_gerar_blobs(IVC* bin, int densidade)
+{
+	unsigned int estado = 7;
+	int nblobs, passo, gx, gy, x, y, x0, y0, w, h;
+
+	memset(bin->data, 0, bin->bytesperline * bin->height);
+
+	nblobs = (int)((double)bin->width * bin->height * densidade / 1e6 + 0.5);
+	if (nblobs <= 0)
+		return 0;
+
+	// Célula da grelha com a área média por blob; cada blob ocupa até metade da célula
+	passo = 1;
+	while ((long long)(bin->width / (passo + 1)) * (bin->height / (passo + 1)) >= nblobs)
+		passo++;
+	if (passo < 4)
+		passo = 4;
+
+	nblobs = 0;
+	for (gy = 0; gy + passo <= bin->height; gy += passo)
+	{
+		for (gx = 0; gx + passo <= bin->width; gx += passo)
+		{
+			w = passo / 4 + bench_aleatorio(&estado) % (passo / 4 + 1);
+			h = passo / 4 + bench_aleatorio(&estado) % (passo / 4 + 1);
+			x0 = gx + 1 + bench_aleatorio(&estado) % (passo - w - 1);
+			y0 = gy + 1 + bench_aleatorio(&estado) % (passo - h - 1);
+
+			for (y = y0; y < y0 + h; y++)
+				for (x = x0; x < x0 + w; x++)
+					bin->data[y * bin->bytesperline + x] = 255;
+			nblobs++;
+		}
+	}
+
+	return nblobs;
+}
+
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//                      CASOS DE MEDIÇÃO
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Imagens e parâmetros partilhados por todos os casos de uma resolução
+typedef struct {
+	int width, height;
+	int kernel;					// Tamanho do kernel do caso actual
+	int densidade;				// Blobs por megapixel do caso actual
+	IVC *rgb, *gray, *bin;		// Originais (nunca alterados pelas funções medidas)
+	IVC* hsv;					// rgb convertido para HSV
+	IVC* lab;					// bin etiquetado por vc_binary_blob_labelling
+	IVC *t3, *t1, *u1;			// Imagens de trabalho (3 e 1 canais)
+	IVC* hist;					// Destino de vc_gray_histogram_show (256 x altura)
+	IVC* g3;					// Imagem a cores com 8 pixéis de guarda (vc_image_fill_guard)
+	BVC *mbin, *m1;				// bin em máscara de 1 bit por pixel e máscara de trabalho
+	RLEVC *rbin, *r1;			// bin em corridas e corridas de trabalho
+	IVC* ref4;					// Amostras de rgb com passo 4 (referência de vc_motion_score)
+	IVC *d2, *d4;				// Destinos de vc_image_downsample (rgb reduzida 2x e 4x)
+	IVC* res;					// Resultado de vc_read_image / vc_image_new / vistas
+	int* labels;
+	unsigned int* sum;
+	unsigned long long* sqsum;
+	OVC *blobs, *blobs32;		// Blobs de bin (8 e 32 bits), para as funções de informação e desenho
+	int nblobs, nblobs32;
+	OVC* saida;					// Blobs devolvidos pela função medida
+	OVC* lista;					// Vector de vc_rle_blob_labelling_into (cresce no aquecimento)
+	int maxlista;
+	TRACKVC* tracker;			// Seguidor do fluxo sintético (linha de contagem a meia altura)
+	OVC fluxo[BENCH_FLUXO];		// Blobs da frame actual do fluxo
+	OVC janelas[BENCH_FLUXO * 2];	// Destino de vc_tracker_predict
+	int idsfluxo[BENCH_FLUXO], eventos[BENCH_FLUXO];
+	int nframe;					// Frame actual do fluxo
+	int nsaida;
+} BENCHCTX;
+
+typedef struct {
+	const char* nome;
+	int parametro;						// BENCH_KERNEL, BENCH_DENSIDADE ou 0
+	double bytes;						// Bytes lidos + escritos por pixel (máscaras de 1 bit: 1/8 por pixel)
+	void (*preparar)(BENCHCTX* c);		// Antes de cada repetição, fora da medição (p.ex. repor a entrada)
+	int (*executar)(BENCHCTX* c);		// Medido; devolve 0 em caso de erro
+	void (*limpar)(BENCHCTX* c);		// Depois de cada repetição, fora da medição
+} BENCHCASO;
+
+#define BENCH_KERNEL 1
+#define BENCH_DENSIDADE 2
+
+static void copiar(IVC* dst, IVC* src)
+{
+	memcpy(dst->data, src->data, src->bytesperline * src->height);
+}
+
+static void prep_t3_rgb(BENCHCTX* c) { copiar(c->t3, c->rgb); }
+static void prep_t3_hsv(BENCHCTX* c) { copiar(c->t3, c->hsv); }
+static void prep_t1_gray(BENCHCTX* c) { copiar(c->t1, c->gray); }
+static void prep_ficheiro(BENCHCTX* c) { vc_write_image(FICHEIRO_PPM, c->rgb); }
+
+// Fluxo sintético: BENCH_FLUXO resistências (160 x 60) em 4 colunas, a descer 7 pixéis por frame;
+// ao sair por baixo voltam a entrar por cima (trajectórias perdidas e novas, como no vídeo)
+static void prep_fluxo(BENCHCTX* c)
+{
+	int i, y;
+
+	c->nframe++;
+	for (i = 0; i < BENCH_FLUXO; i++)
+	{
+		y = ((i / 4) * c->height / 4 + c->nframe * 7) % c->height;
+		c->fluxo[i].x = (i % 4) * c->width / 4 + 8;
+		c->fluxo[i].y = y;
+		c->fluxo[i].width = 160;
+		c->fluxo[i].height = 60;
+		c->fluxo[i].xc = c->fluxo[i].x + 80;
+		c->fluxo[i].yc = y + 30;
+		c->fluxo[i].area = 160 * 60;
+		c->fluxo[i].perimeter = 2 * (160 + 60);
+		c->fluxo[i].label = i + 1;
+	}
+}
+
+// vc_tracker_predict parte do estado deixado por uma actualização com o fluxo
+static void prep_tracker(BENCHCTX* c)
+{
+	prep_fluxo(c);
+	vc_tracker_update(c->tracker, c->fluxo, BENCH_FLUXO, 1, NULL, c->idsfluxo, c->eventos);
+}
+
+static void limpar_res(BENCHCTX* c) { c->res = vc_image_free(c->res); }
+static void limpar_saida(BENCHCTX* c) { c->saida = vc_blob_list_free(c->saida); }
+
+static int ex_image_new_free(BENCHCTX* c) { c->res = vc_image_new(c->width, c->height, 3, 255); c->res = vc_image_free(c->res); return 1; }
+static int ex_image_new_aligned_free(BENCHCTX* c) { c->res = vc_image_new_aligned(c->width, c->height, 3, 255, 8); c->res = vc_image_free(c->res); return 1; }
+static int ex_image_borrow_free(BENCHCTX* c) { c->res = vc_image_borrow(c->width, c->height, 3, 255); c->res = vc_image_free(c->res); return 1; }
+static int ex_image_fill_guard(BENCHCTX* c) { return vc_image_fill_guard(c->g3); }
+static int ex_image_wrap(BENCHCTX* c) { c->res = vc_image_wrap(c->rgb->data, c->width, c->height, 3, 255, 0); return c->res != NULL; }
+static int ex_image_roi(BENCHCTX* c) { c->res = vc_image_roi(c->rgb, c->width / 4, c->height / 4, c->width / 2, c->height / 2); return c->res != NULL; }
+static int ex_read_image(BENCHCTX* c) { c->res = vc_read_image(FICHEIRO_PPM); return c->res != NULL; }
+static int ex_write_image(BENCHCTX* c) { return vc_write_image(FICHEIRO_PPM, c->rgb); }
+static int ex_rgb_to_binary(BENCHCTX* c) { return vc_rgb_to_binary(c->t3); }
+static int ex_rgb_to_hsv(BENCHCTX* c) { return vc_rgb_to_hsv(c->t3); }
+static int ex_hsv_segmentation(BENCHCTX* c) { return vc_hsv_segmentation(c->t3, 0, 141, 102, 153, 102, 191); }
+static int ex_rgb_to_hsv_segmentation(BENCHCTX* c) { return vc_rgb_to_hsv_segmentation(c->rgb, c->t3, c->t1, 0, 141, 102, 153, 102, 191); }
+static int ex_scale_gray_to_rgb(BENCHCTX* c) { return vc_scale_gray_to_rgb(c->gray, c->t3); }
+static int ex_rgb_to_gray(BENCHCTX* c) { return vc_rgb_to_gray(c->rgb, c->t1); }
+static int ex_bgr_to_gray(BENCHCTX* c) { return vc_bgr_to_gray(c->rgb, c->t1); }
+static int ex_gray_to_binary(BENCHCTX* c) { return vc_gray_to_binary(c->t1, 128); }
+static int ex_gray_to_binary_media(BENCHCTX* c) { return vc_gray_to_binary_media(c->t1); }
+static int ex_midpoint(BENCHCTX* c) { return vc_gray_to_binary_midpoint(c->gray, c->t1, c->kernel); }
+static int ex_bernsen(BENCHCTX* c) { return vc_gray_to_binary_bernsen(c->gray, c->t1, c->kernel, 15); }
+static int ex_niblack(BENCHCTX* c) { return vc_gray_to_binary_niblack(c->gray, c->t1, c->kernel, -0.2f); }
+static int ex_sauvola(BENCHCTX* c) { return vc_gray_to_binary_sauvola(c->gray, c->t1, c->kernel, 0.5f); }
+static int ex_binary_dilate(BENCHCTX* c) { return vc_binary_dilate(c->bin, c->t1, c->kernel); }
+static int ex_binary_erode(BENCHCTX* c) { return vc_binary_erode(c->bin, c->t1, c->kernel); }
+static int ex_binary_open(BENCHCTX* c) { return vc_binary_open(c->bin, c->t1, c->kernel, c->kernel); }
+static int ex_binary_close(BENCHCTX* c) { return vc_binary_close(c->bin, c->t1, c->kernel); }
+static int ex_gray_dilate(BENCHCTX* c) { return vc_gray_dilate(c->gray, c->t1, c->kernel); }
+static int ex_gray_erode(BENCHCTX* c) { return vc_gray_erode(c->gray, c->t1, c->kernel); }
+static int ex_binary_to_gray(BENCHCTX* c) { return vc_binary_to_gray(c->bin, c->t1); }
+static int ex_histogram_show(BENCHCTX* c) { return vc_gray_histogram_show(c->gray, c->hist); }
+static int ex_histogram_equalization(BENCHCTX* c) { return vc_gray_histogram_equalization(c->gray, c->t1); }
+static int ex_prewitt(BENCHCTX* c) { return vc_gray_edge_prewitt(c->gray, c->t1, 40.0f); }
+static int ex_mean(BENCHCTX* c) { return vc_gray_lowpass_mean_filter(c->gray, c->t1, c->kernel); }
+static int ex_median(BENCHCTX* c) { return vc_gray_lowpass_median_filter(c->gray, c->t1, c->kernel); }
+static int ex_gaussian(BENCHCTX* c) { return vc_gray_lowpass_gaussian_filter(c->gray, c->t1); }
+static int ex_3channels_to_1(BENCHCTX* c) { return vc_3channels_to_1(c->rgb, c->t1); }
+static int ex_3channels_to_1_binary(BENCHCTX* c) { return vc_3channels_to_1_binary(c->rgb, c->t1); }
+static int ex_integral(BENCHCTX* c) { return vc_gray_integral(c->gray, c->sum, c->sqsum); }
+static int ex_mask_from_binary(BENCHCTX* c) { return vc_mask_from_binary(c->bin, c->m1); }
+static int ex_mask_to_binary(BENCHCTX* c) { return vc_mask_to_binary(c->mbin, c->t1); }
+static int ex_mask_and(BENCHCTX* c) { return vc_mask_and(c->mbin, c->mbin, c->m1); }
+static int ex_mask_or(BENCHCTX* c) { return vc_mask_or(c->mbin, c->mbin, c->m1); }
+static int ex_mask_not(BENCHCTX* c) { return vc_mask_not(c->mbin, c->m1); }
+static int ex_mask_count(BENCHCTX* c) { return vc_mask_count(c->mbin) >= 0; }
+static int ex_mask_dilate(BENCHCTX* c) { return vc_mask_dilate(c->mbin, c->m1, c->kernel); }
+static int ex_mask_erode(BENCHCTX* c) { return vc_mask_erode(c->mbin, c->m1, c->kernel); }
+static int ex_mask_open(BENCHCTX* c) { return vc_mask_open(c->mbin, c->m1, c->kernel, c->kernel); }
+static int ex_mask_close(BENCHCTX* c) { return vc_mask_close(c->mbin, c->m1, c->kernel); }
+static int ex_rle_from_binary(BENCHCTX* c) { return vc_rle_from_binary(c->bin, c->r1); }
+static int ex_rle_from_mask(BENCHCTX* c) { return vc_rle_from_mask(c->mbin, c->r1); }
+static int ex_rle_labelling(BENCHCTX* c) { c->saida = vc_rle_blob_labelling(c->rbin, &c->nsaida); return c->nsaida == 0 || c->saida != NULL; }
+static int ex_rle_labelling_into(BENCHCTX* c)
+{
+	int n = vc_rle_blob_labelling_into(c->rbin, c->lista, c->maxlista);
+
+	if (n > c->maxlista)
+	{
+		free(c->lista);
+		c->lista = (OVC*)malloc(n * sizeof(OVC));
+		c->maxlista = (c->lista != NULL) ? n : 0;
+		n = vc_rle_blob_labelling_into(c->rbin, c->lista, c->maxlista);
+	}
+	return n >= 0;
+}
+static int ex_motion_score(BENCHCTX* c) { return vc_motion_score(c->rgb, c->ref4, 4, 24) >= 0; }
+static int ex_motion_update(BENCHCTX* c) { return vc_motion_update(c->rgb, c->ref4, 4); }
+static int ex_motion_hsv_count(BENCHCTX* c) { return vc_motion_hsv_count(c->rgb, 4, 0, 141, 102, 153, 102, 191) >= 0; }
+static int ex_tracker_update(BENCHCTX* c) { return vc_tracker_update(c->tracker, c->fluxo, BENCH_FLUXO, 1, NULL, c->idsfluxo, c->eventos) >= 0; }
+static int ex_tracker_predict(BENCHCTX* c) { return vc_tracker_predict(c->tracker, 1, 16, c->janelas, BENCH_FLUXO * 2) >= 0; }
+static int ex_downsample2(BENCHCTX* c) { return vc_image_downsample(c->rgb, c->d2, 2); }
+static int ex_downsample4(BENCHCTX* c) { return vc_image_downsample(c->rgb, c->d4, 4); }
+static int ex_band_profile(BENCHCTX* c)
+{
+	// A imagem inteira em 4 segmentos (no programa é uma linha de um blob)
+	int hues[4], saturations[4], values[4];
+	return vc_hsv_band_profile(c->hsv, 0, 0, c->width, c->height, (c->width + 3) / 4, hues, saturations, values, 4) == 4;
+}
+static int ex_labelling(BENCHCTX* c) { c->saida = vc_binary_blob_labelling(c->bin, c->t1, &c->nsaida); return c->nsaida == 0 || c->saida != NULL; }
+static int ex_labelling32(BENCHCTX* c) { c->saida = vc_binary_blob_labelling32(c->bin, c->labels, &c->nsaida); return c->nsaida == 0 || c->saida != NULL; }
+static int ex_blob_info(BENCHCTX* c) { return c->nblobs == 0 || vc_binary_blob_info(c->lab, c->blobs, c->nblobs); }
+static int ex_blob_info32(BENCHCTX* c) { return c->nblobs32 == 0 || vc_binary_blob_info32(c->labels, c->width, c->height, c->blobs32, c->nblobs32); }
+static int ex_normalizar_labelling(BENCHCTX* c) { return vc_normalizar_imagem_labelling(c->lab, c->t1, c->nblobs); }
+static int ex_draw_center_of_mass(BENCHCTX* c) { return c->nblobs32 == 0 || vc_draw_center_of_mass(c->t3, c->blobs32, c->nblobs32, 10, 255); }
+
+static int ex_draw_boundingbox(BENCHCTX* c)
+{
+	int i;
+
+	for (i = 0; i < c->nblobs32; i++)
+	{
+		if (!vc_draw_boundingbox(c->t3, &c->blobs32[i]))
+			return 0;
+	}
+
+	return 1;
+}
+
+// vc_set_num_threads / vc_get_num_threads não são medidas: configuram as outras (--threads)
+static const BENCHCASO casos[] = {
+	{ "vc_image_new_free", 0, 0, NULL, ex_image_new_free, NULL },
+	{ "vc_image_new_aligned_free", 0, 0, NULL, ex_image_new_aligned_free, NULL },
+	{ "vc_image_borrow_free", 0, 0, NULL, ex_image_borrow_free, NULL },
+	{ "vc_image_fill_guard", 0, 0, NULL, ex_image_fill_guard, NULL },
+	{ "vc_image_wrap", 0, 0, NULL, ex_image_wrap, limpar_res },
+	{ "vc_image_roi", 0, 0, NULL, ex_image_roi, limpar_res },
+	{ "vc_write_image", 0, 3, NULL, ex_write_image, NULL },
+	{ "vc_read_image", 0, 3, prep_ficheiro, ex_read_image, limpar_res },
+	{ "vc_rgb_to_binary", 0, 6, prep_t3_rgb, ex_rgb_to_binary, NULL },
+	{ "vc_rgb_to_hsv", 0, 6, prep_t3_rgb, ex_rgb_to_hsv, NULL },
+	{ "vc_hsv_segmentation", 0, 6, prep_t3_hsv, ex_hsv_segmentation, NULL },
+	{ "vc_rgb_to_hsv_segmentation", 0, 7, NULL, ex_rgb_to_hsv_segmentation, NULL },
+	{ "vc_scale_gray_to_rgb", 0, 4, NULL, ex_scale_gray_to_rgb, NULL },
+	{ "vc_rgb_to_gray", 0, 4, NULL, ex_rgb_to_gray, NULL },
+	{ "vc_bgr_to_gray", 0, 4, NULL, ex_bgr_to_gray, NULL },
+	{ "vc_gray_to_binary", 0, 2, prep_t1_gray, ex_gray_to_binary, NULL },
+	{ "vc_gray_to_binary_media", 0, 3, prep_t1_gray, ex_gray_to_binary_media, NULL },
+	{ "vc_gray_to_binary_midpoint", BENCH_KERNEL, 2, NULL, ex_midpoint, NULL },
+	{ "vc_gray_to_binary_bernsen", BENCH_KERNEL, 2, NULL, ex_bernsen, NULL },
+	{ "vc_gray_to_binary_niblack", BENCH_KERNEL, 2, NULL, ex_niblack, NULL },
+	{ "vc_gray_to_binary_sauvola", BENCH_KERNEL, 2, NULL, ex_sauvola, NULL },
+	{ "vc_binary_dilate", BENCH_KERNEL, 2, NULL, ex_binary_dilate, NULL },
+	{ "vc_binary_erode", BENCH_KERNEL, 2, NULL, ex_binary_erode, NULL },
+	{ "vc_binary_open", BENCH_KERNEL, 4, NULL, ex_binary_open, NULL },
+	{ "vc_binary_close", BENCH_KERNEL, 4, NULL, ex_binary_close, NULL },
+	{ "vc_gray_dilate", BENCH_KERNEL, 2, NULL, ex_gray_dilate, NULL },
+	{ "vc_gray_erode", BENCH_KERNEL, 2, NULL, ex_gray_erode, NULL },
+	{ "vc_binary_to_gray", 0, 2, NULL, ex_binary_to_gray, NULL },
+	{ "vc_gray_histogram_show", 0, 1, NULL, ex_histogram_show, NULL },
+	{ "vc_gray_histogram_equalization", 0, 3, NULL, ex_histogram_equalization, NULL },
+	{ "vc_gray_edge_prewitt", 0, 2, NULL, ex_prewitt, NULL },
+	{ "vc_gray_lowpass_mean_filter", BENCH_KERNEL, 2, NULL, ex_mean, NULL },
+	{ "vc_gray_lowpass_median_filter", BENCH_KERNEL, 2, NULL, ex_median, NULL },
+	{ "vc_gray_lowpass_gaussian_filter", 0, 2, NULL, ex_gaussian, NULL },
+	{ "vc_3channels_to_1", 0, 4, NULL, ex_3channels_to_1, NULL },
+	{ "vc_3channels_to_1_binary", 0, 4, NULL, ex_3channels_to_1_binary, NULL },
+	{ "vc_gray_integral", 0, 13, NULL, ex_integral, NULL },
+	// Máscaras: as duas passagens (linhas e colunas) da morfologia lêem e escrevem 1/8 de byte por pixel cada;
+	// vc_motion_*: 3 bytes da imagem e 3 da referência em cada 16 pixéis (passo 4); vc_motion_hsv_count só lê a imagem
+	// vc_rle_*: as corridas dependem da densidade; contam como a máscara de 1 bit equivalente
+	{ "vc_mask_from_binary", 0, 1.125, NULL, ex_mask_from_binary, NULL },
+	{ "vc_mask_to_binary", 0, 1.125, NULL, ex_mask_to_binary, NULL },
+	{ "vc_mask_and", 0, 0.375, NULL, ex_mask_and, NULL },
+	{ "vc_mask_or", 0, 0.375, NULL, ex_mask_or, NULL },
+	{ "vc_mask_not", 0, 0.25, NULL, ex_mask_not, NULL },
+	{ "vc_mask_count", 0, 0.125, NULL, ex_mask_count, NULL },
+	{ "vc_mask_dilate", BENCH_KERNEL, 0.5, NULL, ex_mask_dilate, NULL },
+	{ "vc_mask_erode", BENCH_KERNEL, 0.5, NULL, ex_mask_erode, NULL },
+	{ "vc_mask_open", BENCH_KERNEL, 1.0, NULL, ex_mask_open, NULL },
+	{ "vc_mask_close", BENCH_KERNEL, 1.0, NULL, ex_mask_close, NULL },
+	{ "vc_motion_score", 0, 0.375, NULL, ex_motion_score, NULL },
+	{ "vc_motion_update", 0, 0.375, NULL, ex_motion_update, NULL },
+	{ "vc_motion_hsv_count", 0, 0.1875, NULL, ex_motion_hsv_count, NULL },
+	{ "vc_image_downsample_x2", 0, 3.75, NULL, ex_downsample2, NULL },
+	{ "vc_image_downsample_x4", 0, 3.1875, NULL, ex_downsample4, NULL },
+	{ "vc_hsv_band_profile", 0, 3, NULL, ex_band_profile, NULL },
+	// vc_tracker_*: não lêem pixéis (BENCH_FLUXO blobs por frame); o tempo por pixel só serve para comparar execuções
+	{ "vc_tracker_update", 0, 0, prep_fluxo, ex_tracker_update, NULL },
+	{ "vc_tracker_predict", 0, 0, prep_tracker, ex_tracker_predict, NULL },
+	{ "vc_binary_blob_labelling", BENCH_DENSIDADE, 2, NULL, ex_labelling, limpar_saida },
+	{ "vc_binary_blob_labelling32", BENCH_DENSIDADE, 5, NULL, ex_labelling32, limpar_saida },
+	{ "vc_rle_from_binary", BENCH_DENSIDADE, 1, NULL, ex_rle_from_binary, NULL },
+	{ "vc_rle_from_mask", BENCH_DENSIDADE, 0.125, NULL, ex_rle_from_mask, NULL },
+	{ "vc_rle_blob_labelling", BENCH_DENSIDADE, 0.125, NULL, ex_rle_labelling, limpar_saida },
+	{ "vc_rle_blob_labelling_into", BENCH_DENSIDADE, 0.125, NULL, ex_rle_labelling_into, NULL },
+	{ "vc_binary_blob_info", BENCH_DENSIDADE, 1, NULL, ex_blob_info, NULL },
+	{ "vc_binary_blob_info32", BENCH_DENSIDADE, 4, NULL, ex_blob_info32, NULL },
+	{ "vc_normalizar_imagem_labelling", BENCH_DENSIDADE, 2, NULL, ex_normalizar_labelling, NULL },
+	{ "vc_draw_boundingbox", BENCH_DENSIDADE, 0, NULL, ex_draw_boundingbox, NULL },
+	{ "vc_draw_center_of_mass", BENCH_DENSIDADE, 0, NULL, ex_draw_center_of_mass, NULL },
+};
+
+#define NCASOS ((int)(sizeof(casos) / sizeof(casos[0])))
+
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//                   PREPARAÇÃO E MEDIÇÃO
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+static int bench_ctx_new(BENCHCTX* c, int width, int height)
+{
+	memset(c, 0, sizeof(*c));
+	c->width = width;
+	c->height = height;
+	c->densidade = -1;
+
+	c->rgb = vc_image_new(width, height, 3, 255);
+	c->gray = vc_image_new(width, height, 1, 255);
+	c->bin = vc_image_new(width, height, 1, 255);
+	c->hsv = vc_image_new(width, height, 3, 255);
+	c->t3 = vc_image_new(width, height, 3, 255);
+	c->t1 = vc_image_new(width, height, 1, 255);
+	c->u1 = vc_image_new(width, height, 1, 255);
+	c->hist = vc_image_new(256, height, 1, 255);
+	c->g3 = vc_image_new_aligned(width, height, 3, 255, 8);
+	c->mbin = vc_mask_new(width, height);
+	c->m1 = vc_mask_new(width, height);
+	c->rbin = vc_rle_new(width, height);
+	c->r1 = vc_rle_new(width, height);
+	c->ref4 = vc_image_new((width + 3) / 4, (height + 3) / 4, 3, 255);
+	c->d2 = vc_image_new_aligned(width / 2, height / 2, 3, 255, 0);
+	c->d4 = vc_image_new_aligned(width / 4, height / 4, 3, 255, 0);
+	c->tracker = vc_tracker_new(BENCH_FLUXO * 2, height / 2, 10, 100, 3);
+	c->labels = (int*)malloc((size_t)width * height * sizeof(int));
+	c->sum = (unsigned int*)malloc((size_t)(width + 1) * (height + 1) * sizeof(unsigned int));
+	c->sqsum = (unsigned long long*)malloc((size_t)(width + 1) * (height + 1) * sizeof(unsigned long long));
+
+	// Verificação de erros
+	if (c->rgb == NULL || c->gray == NULL || c->bin == NULL || c->hsv == NULL || c->t3 == NULL || c->t1 == NULL ||
+		c->u1 == NULL || c->hist == NULL || c->g3 == NULL || c->mbin == NULL || c->m1 == NULL || c->rbin == NULL || c->r1 == NULL || c->ref4 == NULL || c->d2 == NULL || c->d4 == NULL || c->tracker == NULL || c->labels == NULL || c->sum == NULL || c->sqsum == NULL)
+		return 0;
+
+	// Cena de referência: densidade média de blobs na imagem a cores e nas imagens derivadas
+	bench_gerar_blobs(c->u1, 100);
+	bench_gerar_rgb(c->rgb, c->u1);
+	copiar(c->hsv, c->rgb);
+	vc_rgb_to_hsv(c->hsv);
+	vc_rgb_to_gray(c->rgb, c->gray);
+	vc_motion_update(c->rgb, c->ref4, 4);
+
+	return 1;
+}
+
+// Imagem binária e blobs de referência para uma densidade
+static void bench_ctx_densidade(BENCHCTX* c, int densidade)
+{
+	if (c->densidade == densidade)
+		return;
+	c->densidade = densidade;
+	bench_gerar_blobs(c->bin, densidade);
+	vc_mask_from_binary(c->bin, c->mbin);
+	vc_rle_from_binary(c->bin, c->rbin);
+
+	c->lab = vc_image_free(c->lab);
+	c->blobs = vc_blob_list_free(c->blobs);
+	c->blobs32 = vc_blob_list_free(c->blobs32);
+	c->nblobs = 0;
+	c->nblobs32 = 0;
+
+	// Com mais de 255 blobs as etiquetas de 8 bits saturam em 255 (como no uso real)
+	c->lab = vc_image_new(c->width, c->height, 1, 255);
+	if (c->lab != NULL)
+		c->blobs = vc_binary_blob_labelling(c->bin, c->lab, &c->nblobs);
+	c->blobs32 = vc_binary_blob_labelling32(c->bin, c->labels, &c->nblobs32);
+}
+
+static void bench_ctx_free(BENCHCTX* c)
+{
+	vc_image_free(c->rgb);
+	vc_image_free(c->gray);
+	vc_image_free(c->bin);
+	vc_image_free(c->hsv);
+	vc_image_free(c->lab);
+	vc_image_free(c->t3);
+	vc_image_free(c->t1);
+	vc_image_free(c->u1);
+	vc_image_free(c->hist);
+	vc_image_free(c->g3);
+	vc_mask_free(c->mbin);
+	vc_mask_free(c->m1);
+	vc_rle_free(c->rbin);
+	vc_rle_free(c->r1);
+	vc_image_free(c->ref4);
+	vc_image_free(c->d2);
+	vc_image_free(c->d4);
+	vc_tracker_free(c->tracker);
+	free(c->labels);
+	free(c->sum);
+	free(c->sqsum);
+	vc_blob_list_free(c->blobs);
+	vc_blob_list_free(c->blobs32);
+	free(c->lista);
+}
+
+static int comparar_double(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+
+	return (x > y) - (x < y);
+}
+
+static const char* nomes_res[] = { "vga", "720p", "1080p", "4k" };
+static const int larguras_res[] = { 640, 1280, 1920, 3840 };
+static const int alturas_res[] = { 480, 720, 1080, 2160 };
+
+// Mede um caso (mínimo de 3 repetições e min_ms milissegundos) e escreve o resultado
+static void bench_medir(const BENCHCASO* caso, BENCHCTX* c, const char* res, int csv, double min_ms)
+{
+	static double tempos[MAX_REPETICOES];
+	double t0, total = 0.0, pixeis = (double)c->width * c->height;
+	double minimo, mediana, mbs;
+	int n, ok = 1;
+
+	// Aquecimento (caches, páginas e threads do pool)
+	if (caso->preparar) caso->preparar(c);
+	ok = caso->executar(c);
+	if (caso->limpar) caso->limpar(c);
+
+	for (n = 0; ok && n < MAX_REPETICOES && (n < 3 || total < min_ms * 1e6); n++)
+	{
+		if (caso->preparar) caso->preparar(c);
+		t0 = bench_ns();
+		ok = caso->executar(c);
+		tempos[n] = bench_ns() - t0;
+		if (caso->limpar) caso->limpar(c);
+		total += tempos[n];
+	}
+
+	if (!ok)
+	{
+		if (csv)
+			printf("%s,%s,%d,%d,%d,%d,%d,0,,,,,falhou\n", caso->nome, res, c->width, c->height,
+				caso->parametro == BENCH_KERNEL ? c->kernel : 0, caso->parametro == BENCH_DENSIDADE ? c->densidade : 0, vc_get_num_threads());
+		else
+			printf("%-32s %-6s %6d %6d   falhou\n", caso->nome, res, caso->parametro == BENCH_KERNEL ? c->kernel : 0,
+				caso->parametro == BENCH_DENSIDADE ? c->densidade : 0);
+		return;
+	}
+
+	qsort(tempos, n, sizeof(double), comparar_double);
+	minimo = tempos[0] / pixeis;
+	mediana = tempos[n / 2] / pixeis;
+	mbs = caso->bytes * pixeis / (tempos[n / 2] * 1e-9) / 1e6;
+
+	if (csv)
+		printf("%s,%s,%d,%d,%d,%d,%d,%d,%.4f,%.4f,%.3f,%.1f,ok\n", caso->nome, res, c->width, c->height,
+			caso->parametro == BENCH_KERNEL ? c->kernel : 0, caso->parametro == BENCH_DENSIDADE ? c->densidade : 0,
+			vc_get_num_threads(), n, minimo, mediana, tempos[n / 2] * 1e-6, mbs);
+	else
+		printf("%-32s %-6s %6d %6d %6d %12.4f %12.4f %10.3f %10.1f\n", caso->nome, res,
+			caso->parametro == BENCH_KERNEL ? c->kernel : 0, caso->parametro == BENCH_DENSIDADE ? c->densidade : 0,
+			n, minimo, mediana, tempos[n / 2] * 1e-6, mbs);
+	fflush(stdout);
+}
+
+// Lê uma lista de inteiros separados por vírgulas
+static int ler_lista(const char* texto, int* lista)
+{
+	int n = 0;
+	const char* p = texto;
+
+	while (*p && n < MAX_LISTA)
+	{
+		lista[n++] = atoi(p);
+		p = strchr(p, ',');
+		if (p == NULL)
+			break;
+		p++;
+	}
+
+	return n;
+}
+
+int main(int argc, char* argv[])
+{
+	int kernels[MAX_LISTA] = { 3, 7, 15, 31 };
+	int densidades[MAX_LISTA] = { 10, 100, 1000 };
+	int nkernels = 4, ndensidades = 3;
+	const char* resolucoes = "vga,720p,1080p,4k";
+	const char* funcao = NULL;
+	double min_ms = 100.0;
+	int csv = 0;
+	int r, i, k, a;
+	BENCHCTX c;
+
+	for (a = 1; a < argc; a++)
+	{
+		if (strcmp(argv[a], "--csv") == 0) csv = 1;
+		else if (strcmp(argv[a], "--res") == 0 && a + 1 < argc) resolucoes = argv[++a];
+		else if (strcmp(argv[a], "--kernels") == 0 && a + 1 < argc) nkernels = ler_lista(argv[++a], kernels);
+		else if (strcmp(argv[a], "--densidades") == 0 && a + 1 < argc) ndensidades = ler_lista(argv[++a], densidades);
+		else if (strcmp(argv[a], "--funcao") == 0 && a + 1 < argc) funcao = argv[++a];
+		else if (strcmp(argv[a], "--threads") == 0 && a + 1 < argc) vc_set_num_threads(atoi(argv[++a]));
+		else if (strcmp(argv[a], "--min-ms") == 0 && a + 1 < argc) min_ms = atof(argv[++a]);
+		else
+		{
+			fprintf(stderr, "Uso: %s [--csv] [--res vga,720p,1080p,4k] [--kernels 3,7,15,31] [--densidades 10,100,1000]\n"
+				"       [--funcao nome] [--threads n] [--min-ms t]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (csv)
+		printf("funcao,resolucao,largura,altura,kernel,densidade,threads,repeticoes,ns_pixel_min,ns_pixel_mediana,ms_mediana,mb_s,estado\n");
+	else
+		printf("%-32s %-6s %6s %6s %6s %12s %12s %10s %10s\n", "funcao", "res", "kernel", "dens", "reps", "ns/px min", "ns/px med", "ms med", "MB/s");
+
+	for (r = 0; r < 4; r++)
+	{
+		if (strstr(resolucoes, nomes_res[r]) == NULL)
+			continue;
+
+		if (!bench_ctx_new(&c, larguras_res[r], alturas_res[r]))
+		{
+			fprintf(stderr, "Erro: sem memória para %s\n", nomes_res[r]);
+			bench_ctx_free(&c);
+			return 1;
+		}
+
+		for (i = 0; i < NCASOS; i++)
+		{
+			if (funcao != NULL && strcmp(funcao, casos[i].nome) != 0)
+				continue;
+
+			if (casos[i].parametro == BENCH_KERNEL)
+			{
+				bench_ctx_densidade(&c, 100);
+				for (k = 0; k < nkernels; k++)
+				{
+					c.kernel = kernels[k];
+					bench_medir(&casos[i], &c, nomes_res[r], csv, min_ms);
+				}
+			}
+			else if (casos[i].parametro == BENCH_DENSIDADE)
+			{
+				for (k = 0; k < ndensidades; k++)
+				{
+					bench_ctx_densidade(&c, densidades[k]);
+					bench_medir(&casos[i], &c, nomes_res[r], csv, min_ms);
+				}
+			}
+			else
+			{
+				bench_ctx_densidade(&c, 100);
+				bench_medir(&casos[i], &c, nomes_res[r], csv, min_ms);
+			}
+		}
+
+		bench_ctx_free(&c);
+	}
+
+	remove(FICHEIRO_PPM);
+
+	return 0;
+}
@@ -13,51 +13,538 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
+#include <stdlib.h>
 #include <malloc.h>
 #include "vc.h"
 #include <math.h>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 #ifndef MAX
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #endif
 
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+#define CLAMP(x, min, max) (((x) < (min)) ? (min) : (((x) > (max)) ? (max) : (x)))
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//                 SIMD (SSE4.1, COM VERIFICAÇÃO DO CPU)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// As versões SSE4.1 são compiladas sempre que o compilador o permite (x86/x64) e escolhidas em
+// tempo de execução se o processador as suportar; caso contrário usa-se a versão escalar.
+// Para forçar a versão escalar, comentar VC_USE_SIMD em vc.h.
+#if defined(VC_USE_SIMD) && defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define VC_SIMD_SSE41
+#define VC_TARGET_SSE41
+#elif defined(VC_USE_SIMD) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#include <cpuid.h>
+#define VC_SIMD_SSE41
+#define VC_TARGET_SSE41 __attribute__((target("sse4.1")))
+#endif
+
+#ifdef VC_SIMD_SSE41
+// Devolve 1 se o processador suporta SSE4.1 (CPUID.1:ECX bit 19)
+static int vc_cpu_has_sse41(void)
+{
+	static int suporta = -1;
+
+	if (suporta < 0)
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		suporta = (info[2] >> 19) & 1;
+#else
+		unsigned int eax, ebx, ecx, edx;
+		suporta = __get_cpuid(1, &eax, &ebx, &ecx, &edx) ? (int)((ecx >> 19) & 1) : 0;
+#endif
+	}
+
+	return suporta;
+}
+
+// Separa 16 pixéis de 3 canais intercalados (48 bytes) em três vectores, um por canal
+VC_TARGET_SSE41 static void vc_sse41_deinterleave3(unsigned char* src, __m128i* c0, __m128i* c1, __m128i* c2)
+{
+	__m128i v0 = _mm_loadu_si128((__m128i*)src);
+	__m128i v1 = _mm_loadu_si128((__m128i*)(src + 16));
+	__m128i v2 = _mm_loadu_si128((__m128i*)(src + 32));
+
+	*c0 = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(v0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(v1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(v2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+	*c1 = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(v0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(v1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(v2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+	*c2 = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(v0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(v1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(v2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+#endif
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//        EXECUÇÃO EM PARALELO (BANDAS DE LINHAS/COLUNAS)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Cada operador divide o trabalho em bandas contíguas [i0, i1[ (linhas ou colunas) e entrega-as
+// a vc_parallel_for, que as distribui por um conjunto fixo de threads. Cada banda lê a imagem de
+// entrada com as linhas vizinhas de que precisa (halo) e escreve só as suas linhas de saída, pelo
+// que o resultado é sempre igual ao da execução numa única thread.
+
+#define VC_MAX_THREADS 64
+
+#ifdef _WIN32
+typedef HANDLE vc_thread_t;
+typedef SRWLOCK vc_mutex_t;
+typedef CONDITION_VARIABLE vc_cond_t;
+#define VC_MUTEX_INIT SRWLOCK_INIT
+#define VC_COND_INIT CONDITION_VARIABLE_INIT
+#define vc_mutex_lock(m) AcquireSRWLockExclusive(m)
+#define vc_mutex_unlock(m) ReleaseSRWLockExclusive(m)
+#define vc_cond_wait(c, m) SleepConditionVariableSRW(c, m, INFINITE, 0)
+#define vc_cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+typedef pthread_t vc_thread_t;
+typedef pthread_mutex_t vc_mutex_t;
+typedef pthread_cond_t vc_cond_t;
+#define VC_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define VC_COND_INIT PTHREAD_COND_INITIALIZER
+#define vc_mutex_lock(m) pthread_mutex_lock(m)
+#define vc_mutex_unlock(m) pthread_mutex_unlock(m)
+#define vc_cond_wait(c, m) pthread_cond_wait(c, m)
+#define vc_cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+// Argumentos de um operador executado por bandas
+typedef struct VCBANDJOB
+{
+	IVC* src;
+	IVC* dst;
+	int kernel;
+	int iparam;
+	float fparam;
+	void* aux;
+	void* aux2;
+} VCBANDJOB;
+
+// Processa a banda número band, que cobre [i0, i1[
+typedef void (*VCBANDFUNC)(VCBANDJOB* job, int band, int i0, int i1);
+
+// Número mínimo de linhas (ou colunas) por banda
+#define VC_BAND_MIN 16
+
+static vc_mutex_t vc_pool_mutex = VC_MUTEX_INIT;
+static vc_cond_t vc_pool_start = VC_COND_INIT;
+static vc_cond_t vc_pool_finish = VC_COND_INIT;
+
+static struct
+{
+	int nthreads;			// Threads a usar (incluindo a que chama); 0 = ainda não definido
+	int nworkers;			// Threads de trabalho criadas
+	vc_thread_t workers[VC_MAX_THREADS];
+	int quit, busy, generation;
+	VCBANDFUNC func;
+	VCBANDJOB* job;
+	int count, nbands, next, done;
+} vc_pool;
+
+// Número de processadores lógicos
+static int vc_cpu_count(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? (int)n : 1;
+#endif
+}
+
+// Executa bandas do trabalho actual até não haver mais (chamada com o mutex fechado)
+static void vc_pool_work(void)
+{
+	VCBANDFUNC func;
+	VCBANDJOB* job;
+	int band, count, nbands;
+
+	while (vc_pool.next < vc_pool.nbands)
+	{
+		band = vc_pool.next++;
+		func = vc_pool.func;
+		job = vc_pool.job;
+		count = vc_pool.count;
+		nbands = vc_pool.nbands;
+
+		vc_mutex_unlock(&vc_pool_mutex);
+		func(job, band, (int)((long long)count * band / nbands), (int)((long long)count * (band + 1) / nbands));
+		vc_mutex_lock(&vc_pool_mutex);
+
+		if (++vc_pool.done == vc_pool.nbands)
+			vc_cond_broadcast(&vc_pool_finish);
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI vc_pool_worker(LPVOID arg)
+#else
+static void* vc_pool_worker(void* arg)
+#endif
+{
+	int generation;
+
+	vc_mutex_lock(&vc_pool_mutex);
+	generation = vc_pool.generation;
+
+	for (;;)
+	{
+		while (!vc_pool.quit && (vc_pool.generation == generation))
+			vc_cond_wait(&vc_pool_start, &vc_pool_mutex);
+		if (vc_pool.quit)
+			break;
+
+		generation = vc_pool.generation;
+		vc_pool_work();
+	}
+
+	vc_mutex_unlock(&vc_pool_mutex);
+
+	return 0;
+}
+
+// Cria as threads de trabalho que faltam (chamada com o mutex fechado)
+static void vc_pool_start_workers(void)
+{
+	if (vc_pool.nthreads <= 0)
+		vc_pool.nthreads = MIN(vc_cpu_count(), VC_MAX_THREADS);
+
+	while (vc_pool.nworkers < vc_pool.nthreads - 1)
+	{
+#ifdef _WIN32
+		vc_pool.workers[vc_pool.nworkers] = CreateThread(NULL, 0, vc_pool_worker, NULL, 0, NULL);
+		if (vc_pool.workers[vc_pool.nworkers] == NULL)
+			break;
+#else
+		if (pthread_create(&vc_pool.workers[vc_pool.nworkers], NULL, vc_pool_worker, NULL) != 0)
+			break;
+#endif
+		vc_pool.nworkers++;
+	}
+}
+
+// Define o número de threads usadas pelos operadores (0 = uma por processador; 1 = sem threads)
+// Não deve ser chamada enquanto outra thread estiver a executar funções vc_*.
+int vc_set_num_threads(int nthreads)
+{
+	int i, n;
+
+	if (nthreads < 0)
+		return 0;
+
+	// Termina as threads existentes; as novas são criadas na próxima execução em paralelo
+	vc_mutex_lock(&vc_pool_mutex);
+	vc_pool.quit = 1;
+	vc_cond_broadcast(&vc_pool_start);
+	n = vc_pool.nworkers;
+	vc_mutex_unlock(&vc_pool_mutex);
+
+	for (i = 0; i < n; i++)
+	{
+#ifdef _WIN32
+		WaitForSingleObject(vc_pool.workers[i], INFINITE);
+		CloseHandle(vc_pool.workers[i]);
+#else
+		pthread_join(vc_pool.workers[i], NULL);
+#endif
+	}
+
+	vc_mutex_lock(&vc_pool_mutex);
+	vc_pool.quit = 0;
+	vc_pool.nworkers = 0;
+	vc_pool.nthreads = (nthreads == 0) ? MIN(vc_cpu_count(), VC_MAX_THREADS) : MIN(nthreads, VC_MAX_THREADS);
+	vc_mutex_unlock(&vc_pool_mutex);
+
+	return 1;
+}
+
+int vc_get_num_threads(void)
+{
+	int n;
+
+	vc_mutex_lock(&vc_pool_mutex);
+	if (vc_pool.nthreads <= 0)
+		vc_pool.nthreads = MIN(vc_cpu_count(), VC_MAX_THREADS);
+	n = vc_pool.nthreads;
+	vc_mutex_unlock(&vc_pool_mutex);
+
+	return n;
+}
+
+// Número de bandas para count linhas (ou colunas) com pelo menos minsize cada
+// Imagens pequenas ficam numa só banda, onde o custo de acordar as threads não compensa.
+static int vc_parallel_nbands(int count, int minsize)
+{
+	int nbands = vc_get_num_threads() * 4;
+
+	nbands = MIN(nbands, count / MAX(minsize, 1));
+
+	return MAX(nbands, 1);
+}
+
+// Executa func sobre as nbands bandas de [0, count[ e espera que terminem todas
+// Se o conjunto de threads já estiver ocupado (chamada a partir de outra thread), executa em série.
+static void vc_parallel_for(VCBANDFUNC func, VCBANDJOB* job, int count, int nbands)
+{
+	int band;
+
+	if (nbands > 1)
+	{
+		vc_mutex_lock(&vc_pool_mutex);
+		if (!vc_pool.busy)
+			vc_pool_start_workers();
+
+		if (!vc_pool.busy && (vc_pool.nworkers > 0))
+		{
+			vc_pool.busy = 1;
+			vc_pool.func = func;
+			vc_pool.job = job;
+			vc_pool.count = count;
+			vc_pool.nbands = nbands;
+			vc_pool.next = 0;
+			vc_pool.done = 0;
+			vc_pool.generation++;
+			vc_cond_broadcast(&vc_pool_start);
+
+			// A thread que chama também processa bandas
+			vc_pool_work();
+			while (vc_pool.done < vc_pool.nbands)
+				vc_cond_wait(&vc_pool_finish, &vc_pool_mutex);
+
+			vc_pool.busy = 0;
+			vc_mutex_unlock(&vc_pool_mutex);
+			return;
+		}
+		vc_mutex_unlock(&vc_pool_mutex);
+	}
+
+	for (band = 0; band < nbands; band++)
+		func(job, band, (int)((long long)count * band / nbands), (int)((long long)count * (band + 1) / nbands));
+}
+
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //            FUN��ES: ALOCAR E LIBERTAR UMA IMAGEM
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 
+// Os pixéis das imagens alocadas começam sempre num endereço múltiplo de VC_ALIGN (linha de cache e
+// largura máxima dos registos vectoriais). vc_image_new_aligned alinha também cada linha e pode deixar
+// pixéis de guarda à volta da imagem: data aponta para o pixel (0, 0) e as guardas ficam antes/depois.
+#define VC_ALIGN 64
+#define VC_ALIGN_UP(n) (((n) + VC_ALIGN - 1) / VC_ALIGN * VC_ALIGN)
+
+static void* vc_aligned_malloc(size_t size)
+{
+#ifdef _WIN32
+	return _aligned_malloc(size, VC_ALIGN);
+#else
+	void* ptr;
+	return (posix_memalign(&ptr, VC_ALIGN, size) == 0) ? ptr : NULL;
+#endif
+}
+
+static void vc_aligned_free(void* ptr)
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+// Início do bloco alocado para os pixéis (antes das linhas e colunas de guarda)
+static unsigned char* vc_image_block(IVC* image)
+{
+	return image->data - (size_t)image->guard * image->bytesperline - VC_ALIGN_UP(image->guard * image->channels);
+}
+
+// Aloca a estrutura e os pixéis: guard linhas/colunas de guarda e linhas com bytesperline bytes
+// (0 = múltiplo de VC_ALIGN que chega para a linha e as duas guardas)
+static IVC* vc_image_alloc(int width, int height, int channels, int levels, int bytesperline, int guard)
+{
+	IVC* image;
+	unsigned char* block;
+	int left;
+
+	if ((width <= 0) || (height <= 0) || (channels <= 0) || (guard < 0))
+		return NULL;
+	if ((levels <= 0) || (levels > 255))
+		return NULL;
+
+	// Guarda da esquerda arredondada a VC_ALIGN, para que cada linha comece alinhada
+	left = VC_ALIGN_UP(guard * channels);
+	if (bytesperline == 0)
+		bytesperline = VC_ALIGN_UP(left + (width + guard) * channels);
+
+	image = (IVC*)malloc(sizeof(IVC));
+	if (image == NULL)
+		return NULL;
+
+	block = (unsigned char*)vc_aligned_malloc((size_t)(height + 2 * guard) * bytesperline);
+	if (block == NULL)
+	{
+		free(image);
+		return NULL;
+	}
+
+	image->data = block + (size_t)guard * bytesperline + left;
+	image->width = width;
+	image->height = height;
+	image->channels = channels;
+	image->levels = levels;
+	image->bytesperline = bytesperline;
+	image->ownsdata = 1;
+	image->guard = guard;
+
+	return image;
+}
+
 // Alocar mem�ria para uma imagem
+// As linhas ficam seguidas (bytesperline = width * channels), sem guardas
 IVC* vc_image_new(int width, int height, int channels, int levels)
 {
-	IVC* image = (IVC*)malloc(sizeof(IVC));
+	return vc_image_alloc(width, height, channels, levels, width * channels, 0);
+}
+
+// Alocar uma imagem com cada linha alinhada a 64 bytes (bytesperline múltiplo de 64) e guard
+// pixéis de guarda de cada lado (linhas acima e abaixo, colunas à esquerda e à direita)
+// Os kernels de vizinhança podem ler até guard pixéis fora da imagem; a memória começa a zeros
+// e vc_image_fill_guard copia para as guardas os pixéis da margem.
+IVC* vc_image_new_aligned(int width, int height, int channels, int levels, int guard)
+{
+	IVC* image = vc_image_alloc(width, height, channels, levels, 0, guard);
 
-	if (image == NULL)
+	if (image != NULL)
+		memset(vc_image_block(image), 0, (size_t)(height + 2 * guard) * image->bytesperline);
+
+	return image;
+}
+
+// Criar uma imagem que usa memória já existente (por exemplo, os dados de um cv::Mat)
+// Nada é copiado: a imagem é uma vista sobre data, com bytesperline bytes por linha
+// (0 = width * channels). vc_image_free liberta só a estrutura, nunca os dados.
+IVC* vc_image_wrap(unsigned char* data, int width, int height, int channels, int levels, int bytesperline)
+{
+	IVC* image;
+
+	if ((data == NULL) || (width <= 0) || (height <= 0) || (channels <= 0))
 		return NULL;
 	if ((levels <= 0) || (levels > 255))
 		return NULL;
+	if (bytesperline == 0)
+		bytesperline = width * channels;
+	if (bytesperline < width * channels)
+		return NULL;
+
+	image = (IVC*)malloc(sizeof(IVC));
+	if (image == NULL)
+		return NULL;
 
+	image->data = data;
 	image->width = width;
 	image->height = height;
 	image->channels = channels;
 	image->levels = levels;
-	image->bytesperline = image->width * image->channels;
-	image->data = (unsigned char*)malloc(image->width * image->height * image->channels * sizeof(char));
+	image->bytesperline = bytesperline;
+	image->ownsdata = 0;
+	image->guard = 0;
+
+	return image;
+}
+
+// Criar uma vista sobre o rectângulo [x, x + width[ x [y, y + height[ de outra imagem
+// Os pixéis são partilhados com src (mesmo bytesperline); a vista não pode viver mais que src.
+IVC* vc_image_roi(IVC* src, int x, int y, int width, int height)
+{
+	if ((src == NULL) || (src->data == NULL))
+		return NULL;
+	if ((x < 0) || (y < 0) || (width <= 0) || (height <= 0) || (x + width > src->width) || (y + height > src->height))
+		return NULL;
+
+	return vc_image_wrap(src->data + y * src->bytesperline + x * src->channels, width, height, src->channels, src->levels, src->bytesperline);
+}
+
+// Preenche as guardas de uma imagem de vc_image_new_aligned com os pixéis da margem mais próximos
+// (equivale a limitar as coordenadas à imagem, como fazem os kernels com CLAMP)
+int vc_image_fill_guard(IVC* image)
+{
+	unsigned char* row;
+	int width, height, channels, bytesperline, guard;
+	int x, y, c;
+
+	// Verificação de erros
+	if ((image == NULL) || (image->data == NULL))
+		return 0;
 
-	if (image->data == NULL)
+	width = image->width;
+	height = image->height;
+	channels = image->channels;
+	bytesperline = image->bytesperline;
+	guard = image->guard;
+
+	// Colunas: primeiro e último pixel de cada linha
+	for (y = 0; y < height; y++)
 	{
-		return vc_image_free(image);
+		row = image->data + y * bytesperline;
+		for (x = 1; x <= guard; x++)
+		{
+			for (c = 0; c < channels; c++)
+			{
+				row[-x * channels + c] = row[c];
+				row[(width - 1 + x) * channels + c] = row[(width - 1) * channels + c];
+			}
+		}
 	}
 
-	return image;
+	// Linhas: primeira e última linha, já com as colunas de guarda
+	for (y = 1; y <= guard; y++)
+	{
+		memcpy(image->data - y * bytesperline - guard * channels, image->data - guard * channels, (width + 2 * guard) * channels);
+		memcpy(image->data + (height - 1 + y) * bytesperline - guard * channels, image->data + (height - 1) * bytesperline - guard * channels, (width + 2 * guard) * channels);
+	}
+
+	return 1;
 }
 
 // Libertar mem�ria de uma imagem
+// Os dados só são libertados se pertencerem à imagem (nas vistas de vc_image_wrap ficam intactos);
+// as imagens de vc_image_borrow voltam à reserva de buffers
 IVC* vc_image_free(IVC* image)
 {
 	if (image != NULL)
 	{
-		if (image->data != NULL)
+		if (image->ownsdata == 2)
+		{
+			vc_scratch_release(image);
+			return NULL;
+		}
+
+		if ((image->data != NULL) && image->ownsdata)
 		{
-			free(image->data);
+			vc_aligned_free(vc_image_block(image));
 			image->data = NULL;
 		}
 
@@ -68,6 +555,164 @@ IVC* vc_image_free(IVC* image)
 	return image;
 }
 
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//        RESERVA DE BUFFERS TEMPORÁRIOS (IMAGENS E SCRATCH)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// As imagens intermédias, tabelas de trabalho e listas de blobs são emprestadas desta reserva e
+// devolvidas no fim, em vez de malloc/free em cada chamada. Um buffer devolvido fica guardado para
+// o próximo pedido de tamanho parecido, pelo que um ciclo que pede sempre os mesmos tamanhos (p.ex.
+// o processamento de um vídeo) deixa de alocar memória depois das primeiras frames.
+
+#define VC_SCRATCH_SLOTS 32
+#define VC_SCRATCH_GRAIN 4096	// Os tamanhos são arredondados a múltiplos deste valor
+
+static vc_mutex_t vc_scratch_mutex = VC_MUTEX_INIT;
+
+static struct
+{
+	void* ptr;
+	size_t size;
+	int inuse;
+} vc_scratch[VC_SCRATCH_SLOTS];
+
+// Empresta um buffer com pelo menos size bytes (conteúdo indefinido)
+// Devolver com vc_scratch_release. Se a reserva estiver toda em uso, é alocado fora dela.
+void* vc_scratch_borrow(size_t size)
+{
+	int i, melhor = -1, vazio = -1, livre = -1;
+	void* ptr;
+
+	size = (size + VC_SCRATCH_GRAIN - 1) / VC_SCRATCH_GRAIN * VC_SCRATCH_GRAIN;
+	if (size == 0)
+		size = VC_SCRATCH_GRAIN;
+
+	vc_mutex_lock(&vc_scratch_mutex);
+
+	// O menor buffer livre que chega (e não é desproporcionadamente maior); senão uma posição vazia;
+	// senão um buffer livre pequeno demais, que é substituído
+	for (i = 0; i < VC_SCRATCH_SLOTS; i++)
+	{
+		if (vc_scratch[i].inuse)
+			continue;
+		if (vc_scratch[i].ptr == NULL)
+		{
+			if (vazio < 0)
+				vazio = i;
+		}
+		else if ((vc_scratch[i].size >= size) && (vc_scratch[i].size / 4 <= size))
+		{
+			if ((melhor < 0) || (vc_scratch[i].size < vc_scratch[melhor].size))
+				melhor = i;
+		}
+		else if (livre < 0)
+		{
+			livre = i;
+		}
+	}
+
+	if ((melhor < 0) && (vazio < 0) && (livre >= 0))
+	{
+		free(vc_scratch[livre].ptr);
+		vc_scratch[livre].ptr = NULL;
+		vazio = livre;
+	}
+
+	if ((melhor < 0) && (vazio >= 0))
+	{
+		vc_scratch[vazio].ptr = malloc(size);
+		vc_scratch[vazio].size = size;
+		if (vc_scratch[vazio].ptr != NULL)
+			melhor = vazio;
+	}
+
+	if (melhor >= 0)
+	{
+		vc_scratch[melhor].inuse = 1;
+		ptr = vc_scratch[melhor].ptr;
+	}
+	else
+	{
+		ptr = NULL;
+	}
+
+	vc_mutex_unlock(&vc_scratch_mutex);
+
+	// Reserva cheia: buffer avulso (vc_scratch_release liberta-o)
+	if (ptr == NULL)
+		ptr = malloc(size);
+
+	return ptr;
+}
+
+// Devolve um buffer de vc_scratch_borrow à reserva (NULL é ignorado)
+void vc_scratch_release(void* ptr)
+{
+	int i;
+
+	if (ptr == NULL)
+		return;
+
+	vc_mutex_lock(&vc_scratch_mutex);
+	for (i = 0; i < VC_SCRATCH_SLOTS; i++)
+	{
+		if (vc_scratch[i].ptr == ptr)
+		{
+			vc_scratch[i].inuse = 0;
+			break;
+		}
+	}
+	vc_mutex_unlock(&vc_scratch_mutex);
+
+	if (i == VC_SCRATCH_SLOTS)
+		free(ptr);
+}
+
+// Liberta os buffers guardados que não estão emprestados
+void vc_scratch_clear(void)
+{
+	int i;
+
+	vc_mutex_lock(&vc_scratch_mutex);
+	for (i = 0; i < VC_SCRATCH_SLOTS; i++)
+	{
+		if (!vc_scratch[i].inuse && (vc_scratch[i].ptr != NULL))
+		{
+			free(vc_scratch[i].ptr);
+			vc_scratch[i].ptr = NULL;
+			vc_scratch[i].size = 0;
+		}
+	}
+	vc_mutex_unlock(&vc_scratch_mutex);
+}
+
+// Imagem temporária emprestada da reserva (estrutura e pixéis num só buffer)
+// Devolver com vc_image_free; o conteúdo inicial é indefinido.
+IVC* vc_image_borrow(int width, int height, int channels, int levels)
+{
+	IVC* image;
+
+	if ((width <= 0) || (height <= 0) || (channels <= 0))
+		return NULL;
+	if ((levels <= 0) || (levels > 255))
+		return NULL;
+
+	image = (IVC*)vc_scratch_borrow(sizeof(IVC) + (size_t)width * height * channels);
+	if (image == NULL)
+		return NULL;
+
+	image->data = (unsigned char*)(image + 1);
+	image->width = width;
+	image->height = height;
+	image->channels = channels;
+	image->levels = levels;
+	image->bytesperline = width * channels;
+	image->ownsdata = 2;
+	image->guard = 0;
+
+	return image;
+}
+
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 //    FUN��ES: LEITURA E ESCRITA DE IMAGENS (PBM, PGM E PPM)
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
@@ -109,7 +754,7 @@ char* netpbm_get_token(FILE* file, char* tok, int len)
 	return tok;
 }
 
-long int unsigned_char_to_bit(unsigned char* datauchar, unsigned char* databit, int width, int height)
+long int unsigned_char_to_bit(unsigned char* datauchar, unsigned char* databit, int width, int height, int bytesperline)
 {
 	int x, y;
 	int countbits;
@@ -124,7 +769,7 @@ long int unsigned_char_to_bit(unsigned char* datauchar, unsigned char* databit,
 	{
 		for (x = 0; x < width; x++)
 		{
-			pos = width * y + x;
+			pos = bytesperline * y + x;
 
 			if (countbits <= 8)
 			{
@@ -153,7 +798,7 @@ long int unsigned_char_to_bit(unsigned char* datauchar, unsigned char* databit,
 	return counttotalbytes;
 }
 
-void bit_to_unsigned_char(unsigned char* databit, unsigned char* datauchar, int width, int height)
+void bit_to_unsigned_char(unsigned char* databit, unsigned char* datauchar, int width, int height, int bytesperline)
 {
 	int x, y;
 	int countbits;
@@ -166,7 +811,7 @@ void bit_to_unsigned_char(unsigned char* databit, unsigned char* datauchar, int
 	{
 		for (x = 0; x < width; x++)
 		{
-			pos = width * y + x;
+			pos = bytesperline * y + x;
 
 			if (countbits <= 8)
 			{
@@ -266,7 +911,7 @@ IVC* vc_read_image(char* filename)
 				return NULL;
 			}
 
-			bit_to_unsigned_char(tmp, image->data, image->width, image->height);
+			bit_to_unsigned_char(tmp, image->data, image->width, image->height, image->bytesperline);
 
 			free(tmp);
 		}
@@ -324,6 +969,7 @@ int vc_write_image(char* filename, IVC* image)
 	FILE* file = NULL;
 	unsigned char* tmp;
 	long int totalbytes, sizeofbinarydata;
+	int y;
 
 	if (image == NULL)
 		return 0;
@@ -339,7 +985,7 @@ int vc_write_image(char* filename, IVC* image)
 
 			fprintf(file, "%s %d %d\n", "P4", image->width, image->height);
 
-			totalbytes = unsigned_char_to_bit(image->data, tmp, image->width, image->height);
+			totalbytes = unsigned_char_to_bit(image->data, tmp, image->width, image->height, image->bytesperline);
 			printf("Total = %ld\n", totalbytes);
 			if (fwrite(tmp, sizeof(unsigned char), totalbytes, file) != totalbytes)
 			{
@@ -358,14 +1004,18 @@ int vc_write_image(char* filename, IVC* image)
 		{
 			fprintf(file, "%s %d %d 255\n", (image->channels == 1) ? "P5" : "P6", image->width, image->height);
 
-			if (fwrite(image->data, image->bytesperline, image->height, file) != image->height)
+			// Escreve linha a linha (o bytesperline pode incluir bytes de alinhamento ou ser de uma vista)
+			for (y = 0; y < image->height; y++)
 			{
+				if (fwrite(image->data + y * image->bytesperline, image->width * image->channels, 1, file) != 1)
+				{
 #ifdef VC_DEBUG
-				fprintf(stderr, "ERROR -> vc_read_image():\n\tError writing PBM, PGM or PPM file.\n");
+					fprintf(stderr, "ERROR -> vc_read_image():\n\tError writing PBM, PGM or PPM file.\n");
 #endif
 
-				fclose(file);
-				return 0;
+					fclose(file);
+					return 0;
+				}
 			}
 		}
 
@@ -394,17 +1044,99 @@ float fmodf(float a, float b)
 	return a - (int)(a / b) * b;
 }*/
 
-int vc_3channels_to_1(IVC* src, IVC* dst)
-{
-	unsigned char* data_src = (unsigned char*)src->data;
-	unsigned char* data_dst = (unsigned char*)dst->data;
-	int width = src->width;
-	int height = src->height;
-	int bytesperline = src->width * src->channels;
-	int channels = src->channels;
-	int x, y;
-	long int pos;
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//        CONVERSÃO PARA CINZENTOS (VÍRGULA FIXA Q15)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Pesos 0.299, 0.587 e 0.114 em vírgula fixa Q15 (somam exactamente 32768)
+#define VC_GRAY_WR 9798
+#define VC_GRAY_WG 19235
+#define VC_GRAY_WB 3735
+
+#ifdef VC_SIMD_SSE41
+// Núcleo SSE4.1: 16 pixéis por iteração com _mm_madd_epi16; devolve o número de pixéis convertidos
+VC_TARGET_SSE41 static int vc_gray_row_sse41(unsigned char* src, unsigned char* dst, int width, int w0, int w1, int w2)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i w01 = _mm_set1_epi32((w1 << 16) | w0);
+	const __m128i w2z = _mm_set1_epi32(w2);
+	__m128i c0, c1, c2, c01, c2z, lo, hi, s0, s1, s2, s3;
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16)
+	{
+		vc_sse41_deinterleave3(src + 3 * x, &c0, &c1, &c2);
+
+		// Pares (c0,c1) e (c2,0) em 16 bits: cada madd dá c0*w0 + c1*w1 ou c2*w2 em 32 bits
+		c01 = _mm_unpacklo_epi8(c0, c1);
+		c2z = _mm_unpacklo_epi8(c2, zero);
+		lo = _mm_unpacklo_epi8(c01, zero);
+		hi = _mm_unpacklo_epi8(c2z, zero);
+		s0 = _mm_add_epi32(_mm_madd_epi16(lo, w01), _mm_madd_epi16(hi, w2z));
+		lo = _mm_unpackhi_epi8(c01, zero);
+		hi = _mm_unpackhi_epi8(c2z, zero);
+		s1 = _mm_add_epi32(_mm_madd_epi16(lo, w01), _mm_madd_epi16(hi, w2z));
+
+		c01 = _mm_unpackhi_epi8(c0, c1);
+		c2z = _mm_unpackhi_epi8(c2, zero);
+		lo = _mm_unpacklo_epi8(c01, zero);
+		hi = _mm_unpacklo_epi8(c2z, zero);
+		s2 = _mm_add_epi32(_mm_madd_epi16(lo, w01), _mm_madd_epi16(hi, w2z));
+		lo = _mm_unpackhi_epi8(c01, zero);
+		hi = _mm_unpackhi_epi8(c2z, zero);
+		s3 = _mm_add_epi32(_mm_madd_epi16(lo, w01), _mm_madd_epi16(hi, w2z));
+
+		s0 = _mm_packs_epi32(_mm_srli_epi32(s0, 15), _mm_srli_epi32(s1, 15));
+		s2 = _mm_packs_epi32(_mm_srli_epi32(s2, 15), _mm_srli_epi32(s3, 15));
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(s0, s2));
+	}
+
+	return x;
+}
+#endif
+
+// Converte uma linha de 3 canais para cinzentos; w0, w1 e w2 são os pesos Q15 de cada canal,
+// pela ordem em que estão na memória (RGB ou BGR)
+static void vc_gray_row(unsigned char* src, unsigned char* dst, int width, int w0, int w1, int w2)
+{
+	int x = 0;
+
+#ifdef VC_SIMD_SSE41
+	if (vc_cpu_has_sse41())
+		x = vc_gray_row_sse41(src, dst, width, w0, w1, w2);
+#endif
+
+	for (; x < width; x++)
+		dst[x] = (unsigned char)((src[x * 3] * w0 + src[x * 3 + 1] * w1 + src[x * 3 + 2] * w2) >> 15);
+}
+
+// Linhas [y0, y1[ da conversão para cinzentos (job->iparam = 1 se a ordem é BGR)
+static void vc_gray_band(VCBANDJOB* job, int band, int y0, int y1)
+{
+	IVC* src = job->src;
+	IVC* dst = job->dst;
+	int wfirst = job->iparam ? VC_GRAY_WB : VC_GRAY_WR;
+	int wlast = job->iparam ? VC_GRAY_WR : VC_GRAY_WB;
+	int y;
+
+	for (y = y0; y < y1; y++)
+	{
+		vc_gray_row(src->data + y * src->bytesperline, dst->data + y * dst->bytesperline, src->width, wfirst, VC_GRAY_WG, wlast);
+	}
+}
+
+// Conversão para cinzentos de uma imagem de 3 canais; bgr indica se o 1º canal é o azul (OpenCV)
+static int vc_gray_convert(IVC* src, IVC* dst, int bgr)
+{
+	VCBANDJOB job = { src, dst, 0, bgr, 0.0f, NULL, NULL };
 
+	vc_parallel_for(vc_gray_band, &job, src->height, vc_parallel_nbands(src->height, VC_BAND_MIN));
+
+	return 1;
+}
+
+int vc_3channels_to_1(IVC* src, IVC* dst)
+{
 	if ((src->width) <= 0 || (src->height <= 0) || (src->data == NULL))
 	{
 		printf("(vc_3chanels_to_1) Tamanhos inválidos\n");
@@ -431,16 +1163,8 @@ int vc_3channels_to_1(IVC* src, IVC* dst)
 		return 0;
 	}
 
-	for (y = 0; y < height; y++)
-	{
-		for (x = 0; x < width; x++)
-		{
-			pos = y * bytesperline + x * channels;
-			data_dst[y * width + x] = (unsigned char)(0.299 * data_src[pos] + 0.587 * data_src[pos + 1] + 0.114 * data_src[pos + 2]);
-		}
-	}
-
-	return 1;
+	// O primeiro canal tem o peso do vermelho (ordem RGB)
+	return vc_gray_convert(src, dst, 0);
 }
 
 int vc_3channels_to_1_binary(IVC* src, IVC* dst)
@@ -449,7 +1173,7 @@ int vc_3channels_to_1_binary(IVC* src, IVC* dst)
 	unsigned char* data_dst = (unsigned char*)dst->data;
 	int width = src->width;
 	int height = src->height;
-	int bytesperline = src->width * src->channels;
+	int bytesperline = src->bytesperline;
 	int channels = src->channels;
 	int x, y;
 	long int pos;
@@ -485,7 +1209,7 @@ int vc_3channels_to_1_binary(IVC* src, IVC* dst)
 		for (x = 0; x < width; x++)
 		{
 			pos = y * bytesperline + x * channels;
-			data_dst[y * width + x] = data_src[pos];
+			data_dst[y * dst->bytesperline + x] = data_src[pos];
 		}
 	}
 
@@ -501,7 +1225,8 @@ int vc_rgb_to_binary(IVC* srcdst)
 	int bytesperline = srcdst->bytesperline;
 	int channels = srcdst->channels;
 	float r, g, b, y, cb, cr;
-	int i, size;
+	unsigned char* line;
+	int i, row, size;
 
 	// Verificação de erros
 	if ((width <= 0) || (height <= 0) || (data == NULL))
@@ -509,46 +1234,216 @@ int vc_rgb_to_binary(IVC* srcdst)
 	if (channels != 3)
 		return 0;
 
-	size = width * height * channels;
+	size = width * channels;
 
-	for (i = 0; i < size; i = i + channels)
+	for (row = 0; row < height; row++)
 	{
-		r = (float)data[i];
-		g = (float)data[i + 1];
-		b = (float)data[i + 2];
+		line = data + row * bytesperline;
+
+		for (i = 0; i < size; i = i + channels)
+		{
+			r = (float)line[i];
+			g = (float)line[i + 1];
+			b = (float)line[i + 2];
+
+			// Conversão de RGB para YCbCr
+			y = 0.299f * r + 0.587f * g + 0.114f * b;
+			cb = 128 - 0.168736f * r - 0.331264f * g + 0.5f * b;
+			cr = 128 + 0.5f * r - 0.418688f * g - 0.081312f * b;
+
+			// Conversão de YCbCr para RGB
+			r = y + 1.402f * (cr - 128);
+			g = y - 0.344136f * (cb - 128) - 0.714136f * (cr - 128);
+			b = y + 1.772f * (cb - 128);
+
+			// Conversão de RGB para binário
+			r = fminf(255.0f, fmaxf(0.0f, r));
+			g = fminf(255.0f, fmaxf(0.0f, g));
+			b = fminf(255.0f, fmaxf(0.0f, b));
+
+			if (r > 127 || g > 127 || b > 127)
+			{
+				line[i] = 0;
+				line[i + 1] = 0;
+				line[i + 2] = 0;
+			}
+			else
+			{
+				line[i] = 255;
+				line[i + 1] = 255;
+				line[i + 2] = 255;
+			}
+		}
+	}
+
+	return 1;
+}
+
+
+// Converte um pixel BGR para HSV, com os três canais entre [0,255]
+static void vc_hsv_pixel(unsigned char* bgr, unsigned char* hsv)
+{
+	float r, g, b, hue, saturation, value;
+	float rgb_max, rgb_min;
 
-		// Conversão de RGB para YCbCr
-		y = 0.299f * r + 0.587f * g + 0.114f * b;
-		cb = 128 - 0.168736f * r - 0.331264f * g + 0.5f * b;
-		cr = 128 + 0.5f * r - 0.418688f * g - 0.081312f * b;
+	b = (float)bgr[0];
+	g = (float)bgr[1];
+	r = (float)bgr[2];
 
-		// Conversão de YCbCr para RGB
-		r = y + 1.402f * (cr - 128);
-		g = y - 0.344136f * (cb - 128) - 0.714136f * (cr - 128);
-		b = y + 1.772f * (cb - 128);
+	// Calcula valores máximo e mínimo dos canais de cor R, G e B
+	rgb_max = (r > g ? (r > b ? r : b) : (g > b ? g : b));
+	rgb_min = (r < g ? (r < b ? r : b) : (g < b ? g : b));
 
-		// Conversão de RGB para binário
-		r = fminf(255.0f, fmaxf(0.0f, r));
-		g = fminf(255.0f, fmaxf(0.0f, g));
-		b = fminf(255.0f, fmaxf(0.0f, b));
+	// Value toma valores entre [0,255]
+	value = rgb_max;
+	if (value == 0.0f)
+	{
+		hue = 0.0f;
+		saturation = 0.0f;
+	}
+	else
+	{
+		// Saturation toma valores entre [0,255]
+		saturation = ((rgb_max - rgb_min) / rgb_max) * 255.0f;
 
-		if (r > 127 || g > 127 || b > 127)
+		if (saturation == 0.0f)
 		{
-			data[i] = 0;
-			data[i + 1] = 0;
-			data[i + 2] = 0;
+			hue = 0.0f;
 		}
 		else
 		{
-			data[i] = 255;
-			data[i + 1] = 255;
-			data[i + 2] = 255;
+			// Hue toma valores entre [0,360]
+			if ((rgb_max == r) && (g >= b))
+			{
+				hue = 60.0f * (g - b) / (rgb_max - rgb_min);
+			}
+			else if ((rgb_max == r) && (b > g))
+			{
+				hue = 360.0f + 60.0f * (g - b) / (rgb_max - rgb_min);
+			}
+			else if (rgb_max == g)
+			{
+				hue = 120.0f + 60.0f * (b - r) / (rgb_max - rgb_min);
+			}
+			else
+			{
+				hue = 240.0f + 60.0f * (r - g) / (rgb_max - rgb_min);
+			}
 		}
 	}
 
-	return 1;
+	// Atribui valores entre [0,255]
+	hsv[0] = (unsigned char)(hue / 360.0f * 255.0f);
+	hsv[1] = (unsigned char)(saturation);
+	hsv[2] = (unsigned char)(value);
+}
+
+#ifdef VC_SIMD_SSE41
+// Converte 4 pixéis (um quarto do bloco de 16) para hue e saturação, com as mesmas operações
+// em vírgula flutuante (e pela mesma ordem) que vc_hsv_pixel, pelo que o resultado é idêntico.
+VC_TARGET_SSE41 static void vc_hsv_simd4(__m128i b8, __m128i g8, __m128i r8, __m128i max8, __m128i min8, __m128i* hue, __m128i* sat)
+{
+	__m128 b = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(b8));
+	__m128 g = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(g8));
+	__m128 r = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(r8));
+	__m128 rgb_max = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(max8));
+	__m128 rgb_min = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(min8));
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 delta = _mm_sub_ps(rgb_max, rgb_min);
+	__m128 delta_zero = _mm_cmpeq_ps(delta, zero);
+	__m128 max_r = _mm_cmpeq_ps(rgb_max, r);
+	__m128 max_g = _mm_cmpeq_ps(rgb_max, g);
+	__m128 num, base, h, s;
+
+	// Saturation = (max - min) / max * 255 (0 se max = 0, caso em que também delta = 0)
+	s = _mm_div_ps(delta, _mm_blendv_ps(rgb_max, one, _mm_cmpeq_ps(rgb_max, zero)));
+	s = _mm_mul_ps(s, _mm_set1_ps(255.0f));
+
+	// Sector do hue, sem saltos: R máximo tem prioridade sobre G, que tem prioridade sobre B
+	num = _mm_sub_ps(r, g);
+	base = _mm_set1_ps(240.0f);
+	num = _mm_blendv_ps(num, _mm_sub_ps(b, r), max_g);
+	base = _mm_blendv_ps(base, _mm_set1_ps(120.0f), max_g);
+	num = _mm_blendv_ps(num, _mm_sub_ps(g, b), max_r);
+	base = _mm_blendv_ps(base, _mm_and_ps(_mm_cmpgt_ps(b, g), _mm_set1_ps(360.0f)), max_r);
+
+	h = _mm_div_ps(_mm_mul_ps(_mm_set1_ps(60.0f), num), _mm_blendv_ps(delta, one, delta_zero));
+	h = _mm_add_ps(base, h);
+	h = _mm_andnot_ps(delta_zero, h);
+	h = _mm_mul_ps(_mm_div_ps(h, _mm_set1_ps(360.0f)), _mm_set1_ps(255.0f));
+
+	*hue = _mm_cvttps_epi32(h);
+	*sat = _mm_cvttps_epi32(s);
+}
+
+// Converte uma linha BGR para HSV, 16 pixéis por iteração; devolve o número de pixéis convertidos
+VC_TARGET_SSE41 static int vc_hsv_row_sse41(unsigned char* src, unsigned char* dst, int width)
+{
+	// Máscaras pshufb para voltar a intercalar os canais (vector de saída k, canal c)
+	const __m128i o00 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+	const __m128i o01 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+	const __m128i o02 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+	const __m128i o10 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+	const __m128i o11 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+	const __m128i o12 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+	const __m128i o20 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+	const __m128i o21 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+	const __m128i o22 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+	__m128i b, g, r, vmax, vmin, h[4], s[4], hue, sat;
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16)
+	{
+		vc_sse41_deinterleave3(src + 3 * x, &b, &g, &r);
+
+		// Value = max(R, G, B)
+		vmax = _mm_max_epu8(_mm_max_epu8(r, g), b);
+		vmin = _mm_min_epu8(_mm_min_epu8(r, g), b);
+
+		// O value é o próprio máximo; hue e saturação são calculados 4 pixéis de cada vez
+		vc_hsv_simd4(b, g, r, vmax, vmin, &h[0], &s[0]);
+		vc_hsv_simd4(_mm_srli_si128(b, 4), _mm_srli_si128(g, 4), _mm_srli_si128(r, 4), _mm_srli_si128(vmax, 4), _mm_srli_si128(vmin, 4), &h[1], &s[1]);
+		vc_hsv_simd4(_mm_srli_si128(b, 8), _mm_srli_si128(g, 8), _mm_srli_si128(r, 8), _mm_srli_si128(vmax, 8), _mm_srli_si128(vmin, 8), &h[2], &s[2]);
+		vc_hsv_simd4(_mm_srli_si128(b, 12), _mm_srli_si128(g, 12), _mm_srli_si128(r, 12), _mm_srli_si128(vmax, 12), _mm_srli_si128(vmin, 12), &h[3], &s[3]);
+
+		hue = _mm_packus_epi16(_mm_packs_epi32(h[0], h[1]), _mm_packs_epi32(h[2], h[3]));
+		sat = _mm_packus_epi16(_mm_packs_epi32(s[0], s[1]), _mm_packs_epi32(s[2], s[3]));
+
+		_mm_storeu_si128((__m128i*)(dst + 3 * x), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(hue, o00), _mm_shuffle_epi8(sat, o01)), _mm_shuffle_epi8(vmax, o02)));
+		_mm_storeu_si128((__m128i*)(dst + 3 * x + 16), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(hue, o10), _mm_shuffle_epi8(sat, o11)), _mm_shuffle_epi8(vmax, o12)));
+		_mm_storeu_si128((__m128i*)(dst + 3 * x + 32), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(hue, o20), _mm_shuffle_epi8(sat, o21)), _mm_shuffle_epi8(vmax, o22)));
+	}
+
+	return x;
+}
+#endif
+
+// Converte uma linha de width pixéis BGR para HSV (src e dst podem coincidir)
+static void vc_hsv_row(unsigned char* src, unsigned char* dst, int width)
+{
+	int x = 0;
+
+#ifdef VC_SIMD_SSE41
+	if (vc_cpu_has_sse41())
+		x = vc_hsv_row_sse41(src, dst, width);
+#endif
+
+	for (; x < width; x++)
+		vc_hsv_pixel(&src[x * 3], &dst[x * 3]);
 }
 
+// Linhas [y0, y1[ da conversão RGB -> HSV (no próprio sítio)
+static void vc_hsv_band(VCBANDJOB* job, int band, int y0, int y1)
+{
+	IVC* srcdst = job->src;
+	int y;
+
+	for (y = y0; y < y1; y++)
+	{
+		vc_hsv_row(srcdst->data + y * srcdst->bytesperline, srcdst->data + y * srcdst->bytesperline, srcdst->width);
+	}
+}
 
 /* Função para converter uma imagem RGB para uma imagem HSV
  * Hue - 0 a 255 (convertido de 0 a 360 graus)
@@ -560,11 +1455,8 @@ int vc_rgb_to_hsv(IVC* srcdst)
 	unsigned char* data = (unsigned char*)srcdst->data;
 	int width = srcdst->width;
 	int height = srcdst->height;
-	int bytesperline = srcdst->bytesperline;
 	int channels = srcdst->channels;
-	float r, g, b, hue, saturation, value;
-	float rgb_max, rgb_min;
-	int i, size;
+	VCBANDJOB job = { srcdst, srcdst, 0, 0, 0.0f, NULL, NULL };
 
 	// Verificação de erros
 	if ((width <= 0) || (height <= 0) || (data == NULL))
@@ -572,61 +1464,85 @@ int vc_rgb_to_hsv(IVC* srcdst)
 	if (channels != 3)
 		return 0;
 
-	size = width * height * channels;
+	vc_parallel_for(vc_hsv_band, &job, height, vc_parallel_nbands(height, VC_BAND_MIN));
 
-	for (i = 0; i < size; i = i + channels)
-	{
-		b = (float)data[i];
-		g = (float)data[i + 1];
-		r = (float)data[i + 2];
+	return 1;
+}
 
-		// Calcula valores máximo e mínimo dos canais de cor R, G e B
-		rgb_max = (r > g ? (r > b ? r : b) : (g > b ? g : b));
-		rgb_min = (r < g ? (r < b ? r : b) : (g < b ? g : b));
+#define VC_HSV_CHUNK 256
 
-		// Value toma valores entre [0,255]
-		value = rgb_max;
-		if (value == 0.0f)
-		{
-			hue = 0.0f;
-			saturation = 0.0f;
-		}
-		else
+// Tabelas lut[3][256] dos intervalos da segmentação HSV (0xFF dentro do intervalo de cada canal)
+static void vc_hsv_range_lut(unsigned char lut[3][256], int hmin, int hmax, int smin, int smax, int vmin, int vmax)
+{
+	int i;
+
+	for (i = 0; i < 256; i++)
+	{
+		lut[0][i] = ((i >= hmin) && (i <= hmax)) ? 0xFF : 0;
+		lut[1][i] = ((i >= smin) && (i <= smax)) ? 0xFF : 0;
+		lut[2][i] = ((i >= vmin) && (i <= vmax)) ? 0xFF : 0;
+	}
+}
+
+// Linhas [y0, y1[ da conversão RGB -> HSV com segmentação
+// job->dst : máscara; job->aux : tabelas lut[3][256]; job->aux2 : imagem HSV ou NULL
+static void vc_hsv_segmentation_band(VCBANDJOB* job, int band, int y0, int y1)
+{
+	IVC* src = job->src;
+	IVC* mask = job->dst;
+	IVC* hsv = (IVC*)job->aux2;
+	unsigned char(*lut)[256] = (unsigned char(*)[256])job->aux;
+	unsigned char bloco[VC_HSV_CHUNK * 3];
+	unsigned char *p, *m;
+	int x, x0, n, y;
+
+	// A conversão é feita por blocos de até VC_HSV_CHUNK pixéis (vectorizada em vc_hsv_row);
+	// sem imagem HSV de saída, o bloco convertido fica num buffer local
+	for (y = y0; y < y1; y++)
+	{
+		for (x0 = 0; x0 < src->width; x0 += VC_HSV_CHUNK)
 		{
-			// Saturation toma valores entre [0,255]
-			saturation = ((rgb_max - rgb_min) / rgb_max) * 255.0f;
+			n = MIN(VC_HSV_CHUNK, src->width - x0);
+			p = (hsv != NULL) ? hsv->data + y * hsv->bytesperline + x0 * 3 : bloco;
+			vc_hsv_row(&src->data[y * src->bytesperline + x0 * 3], p, n);
 
-			if (saturation == 0.0f)
-			{
-				hue = 0.0f;
-			}
-			else
+			m = &mask->data[y * mask->bytesperline + x0];
+			for (x = 0; x < n; x++, p += 3)
 			{
-				// Hue toma valores entre [0,360]
-				if ((rgb_max == r) && (g >= b))
-				{
-					hue = 60.0f * (g - b) / (rgb_max - rgb_min);
-				}
-				else if ((rgb_max == r) && (b > g))
-				{
-					hue = 360.0f + 60.0f * (g - b) / (rgb_max - rgb_min);
-				}
-				else if (rgb_max == g)
-				{
-					hue = 120.0f + 60.0f * (b - r) / (rgb_max - rgb_min);
-				}
-				else
-				{
-					hue = 240.0f + 60.0f * (r - g) / (rgb_max - rgb_min);
-				}
+				m[x] = lut[0][p[0]] & lut[1][p[1]] & lut[2][p[2]];
 			}
 		}
-
-		// Atribui valores entre [0,255]
-		data[i] = (unsigned char)(hue / 360.0f * 255.0f);
-		data[i + 1] = (unsigned char)(saturation);
-		data[i + 2] = (unsigned char)(value);
 	}
+}
+
+/* Conversão RGB -> HSV e segmentação numa única passagem
+ * src  : imagem BGR (3 canais)
+ * hsv  : imagem HSV de saída (3 canais), ou NULL; pode ser a própria src
+ * mask : imagem de saída com 1 canal (255 dentro dos intervalos, 0 fora)
+ * Os intervalos [min,max] estão nas unidades nativas da imagem HSV (0 a 255 nos três canais).
+ * Cada canal é testado numa tabela de 256 entradas (0xFF dentro do intervalo), pelo que a
+ * máscara é o AND das três tabelas.
+ */
+int vc_rgb_to_hsv_segmentation(IVC* src, IVC* hsv, IVC* mask, int hmin, int hmax, int smin, int smax, int vmin, int vmax)
+{
+	int width = src->width;
+	int height = src->height;
+	unsigned char lut[3][256];
+	VCBANDJOB job = { src, mask, 0, 0, 0.0f, lut, hsv };
+
+	// Verificação de erros
+	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL))
+		return 0;
+	if (src->channels != 3)
+		return 0;
+	if ((mask->data == NULL) || (mask->channels != 1) || (mask->width != width) || (mask->height != height))
+		return 0;
+	if ((hsv != NULL) && ((hsv->data == NULL) || (hsv->channels != 3) || (hsv->width != width) || (hsv->height != height)))
+		return 0;
+
+	vc_hsv_range_lut(lut, hmin, hmax, smin, smax, vmin, vmax);
+
+	vc_parallel_for(vc_hsv_segmentation_band, &job, height, vc_parallel_nbands(height, VC_BAND_MIN));
 
 	return 1;
 }
@@ -638,39 +1554,105 @@ int vc_hsv_segmentation(IVC* src, int hmin, int hmax, int smin, int smax, int vm
 	unsigned char* data = (unsigned char*)src->data;
 	int width = src->width;
 	int height = src->height;
-	int bytesperline = src->width * src->channels;
+	int bytesperline = src->bytesperline;
 	int channels = src->channels;
 	float h, s, v;
-	int i, size;
+	int i, x, y;
 
 	if ((src->width) <= 0 || (src->height <= 0) || (src->data == NULL))
 		return 0;
 	if (src->channels != 3)
 		return 0;
 
-	size = width * height * channels;
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			i = y * bytesperline + x * channels;
+
+			h = (float)data[i] * 360.0f / 255.0f;
+			s = (float)data[i + 1] * 100.0f / 255.0f;
+			v = (float)data[i + 2] * 100.0f / 255.0f;
+
+			if (h >= hmin && h <= hmax && s >= smin && s <= smax && v >= vmin && v <= vmax)
+			{
+				data[i] = 255;
+				data[i + 1] = 255;
+				data[i + 2] = 255;
+			}
+			else
+			{
+				data[i] = 0;
+				data[i + 1] = 0;
+				data[i + 2] = 0;
+			}
+		}
+	}
+	return 1;
+}
+
+// Perfil de cores de nrows linhas de uma imagem HSV a partir de (x, y), com width pixéis divididos em segmentos
+// de segsize pixéis (o último pode ser mais curto). Para cada segmento calcula o hue dominante (bin com mais pixéis
+// num histograma de 180 bins, o primeiro em caso de empate; os hues >= 180 não entram) e as médias (truncadas)
+// da saturação e do valor. Uma só passagem pelos pixéis, com o histograma na pilha.
+// Devolve o número de segmentos (no máximo maxsegments; 0 se width <= 0 ou erro)
+int vc_hsv_band_profile(IVC* src, int x, int y, int width, int nrows, int segsize, int* hues, int* saturations, int* values, int maxsegments)
+{
+	unsigned int hist[180];
+	unsigned char* row;
+	unsigned char* p;
+	int bytesperline;
+	int nsegments, seg, x0, w, i, r, best;
+	unsigned int npixels, ssum, vsum;
+
+	// Verificação de erros
+	if ((src == NULL) || (src->data == NULL) || (src->channels != 3))
+		return 0;
+	if ((hues == NULL) || (saturations == NULL) || (values == NULL) || (segsize <= 0) || (nrows <= 0))
+		return 0;
+	if ((x < 0) || (y < 0) || (x + width > src->width) || (y + nrows > src->height))
+		return 0;
+	if (width <= 0)
+		return 0;
+
+	bytesperline = src->bytesperline;
+	nsegments = MIN((width + segsize - 1) / segsize, maxsegments);
 
-	for (i = 0; i < size; i = i + channels)
+	for (seg = 0; seg < nsegments; seg++)
 	{
+		x0 = x + seg * segsize;
+		w = MIN(segsize, x + width - x0);
 
-		h = (float)data[i] * 360.0f / 255.0f;
-		s = (float)data[i + 1] * 100.0f / 255.0f;
-		v = (float)data[i + 2] * 100.0f / 255.0f;
+		memset(hist, 0, sizeof(hist));
+		ssum = 0;
+		vsum = 0;
 
-		if (h >= hmin && h <= hmax && s >= smin && s <= smax && v >= vmin && v <= vmax)
+		row = src->data + (size_t)y * bytesperline + x0 * 3;
+		for (r = 0; r < nrows; r++, row += bytesperline)
 		{
-			data[i] = 255;
-			data[i + 1] = 255;
-			data[i + 2] = 255;
+			for (i = 0, p = row; i < w; i++, p += 3)
+			{
+				if (p[0] < 180)
+					hist[p[0]]++;
+				ssum += p[1];
+				vsum += p[2];
+			}
 		}
-		else
+
+		best = 0;
+		for (i = 1; i < 180; i++)
 		{
-			data[i] = 0;
-			data[i + 1] = 0;
-			data[i + 2] = 0;
+			if (hist[i] > hist[best])
+				best = i;
 		}
+
+		npixels = (unsigned int)w * nrows;
+		hues[seg] = best;
+		saturations[seg] = (int)(ssum / npixels);
+		values[seg] = (int)(vsum / npixels);
 	}
-	return 1;
+
+	return nsegments;
 }
 
 int vc_scale_gray_to_rgb(IVC* src, IVC* dst)
@@ -692,7 +1674,7 @@ int vc_scale_gray_to_rgb(IVC* src, IVC* dst)
 		for (x = 0; x < width; x++)
 		{
 			// Obtém o valor do pixel na imagem em escala de cinza
-			unsigned char gray_value = src->data[y * width + x];
+			unsigned char gray_value = src->data[y * src->bytesperline + x];
 
 			// Calcula os componentes R, G e B com base no valor de cinza
 			unsigned char r, g, b;
@@ -713,9 +1695,9 @@ int vc_scale_gray_to_rgb(IVC* src, IVC* dst)
 			}
 
 			// Define os componentes RGB no destino
-			dst->data[(y * width + x) * channels] = r;	   // R
-			dst->data[(y * width + x) * channels + 1] = g; // G
-			dst->data[(y * width + x) * channels + 2] = b; // B
+			dst->data[y * dst->bytesperline + x * channels] = r;	 // R
+			dst->data[y * dst->bytesperline + x * channels + 1] = g; // G
+			dst->data[y * dst->bytesperline + x * channels + 2] = b; // B
 		}
 	}
 
@@ -726,33 +1708,31 @@ int vc_rgb_to_gray(IVC* src, IVC* dst)
 {
 	if (src == NULL || dst == NULL)
 		return 0;
+	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL) || (dst->data == NULL))
+		return 0;
 
 	// Verifica se a imagem de entrada está em RGB e se a de saída tem apenas um canal
 	if (src->channels != 3 || dst->channels != 1)
 		return 0;
+	if ((src->width != dst->width) || (src->height != dst->height))
+		return 0;
 
-	int width = src->width;
-	int height = src->height;
-	int x, y;
-
-	for (y = 0; y < height; y++)
-	{
-		for (x = 0; x < width; x++)
-		{
-			// Obtém os valores dos canais de cor RGB
-			unsigned char r = src->data[(y * width + x) * src->channels];
-			unsigned char g = src->data[(y * width + x) * src->channels + 1];
-			unsigned char b = src->data[(y * width + x) * src->channels + 2];
-
-			// Calcula o valor de cinza usando a média ponderada
-			unsigned char gray_value = (r * 0.299) + (g * 0.587) + (b * 0.114);
+	return vc_gray_convert(src, dst, 0);
+}
 
-			// Define o valor de cinza na imagem de destino
-			dst->data[y * width + x] = gray_value;
-		}
-	}
+// Igual a vc_rgb_to_gray, mas para imagens com os canais pela ordem BGR (frames do OpenCV)
+int vc_bgr_to_gray(IVC* src, IVC* dst)
+{
+	if (src == NULL || dst == NULL)
+		return 0;
+	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL) || (dst->data == NULL))
+		return 0;
+	if (src->channels != 3 || dst->channels != 1)
+		return 0;
+	if ((src->width != dst->width) || (src->height != dst->height))
+		return 0;
 
-	return 1;
+	return vc_gray_convert(src, dst, 1);
 }
 
 int vc_gray_to_binary(IVC* srcdst, int threshold)
@@ -795,7 +1775,7 @@ int vc_gray_to_binary_media(IVC* srcdst)
 	unsigned char* data = (unsigned char*)srcdst->data;
 	int width = srcdst->width;
 	int height = srcdst->height;
-	int bytesperline = srcdst->width * srcdst->channels;
+	int bytesperline = srcdst->bytesperline;
 	int channels = srcdst->channels;
 	int x, y;
 	long int pos;
@@ -830,43 +1810,37 @@ int vc_gray_to_binary_media(IVC* srcdst)
 	return 1;
 }
 
-int vc_gray_to_binary_midpoint(IVC* src, IVC* dst, int kernel)
+// Linhas [y0, y1[ da limiarização pelo ponto médio (job->iparam < 0) ou de Bernsen (job->iparam = cmin)
+static void vc_midpoint_band(VCBANDJOB* job, int band, int y0, int y1)
 {
-
-	unsigned char* datasrc = (unsigned char*)src->data;
-	int width = src->width;
-	int height = src->height;
-	int bytesperline = src->bytesperline;
-	;
-	int channels = src->channels;
+	unsigned char* datasrc = (unsigned char*)job->src->data;
+	unsigned char* datadst = (unsigned char*)job->dst->data;
+	int width = job->src->width;
+	int height = job->src->height;
+	int levels = job->src->levels;
+	int bytesperline_src = job->src->bytesperline;
+	int bytesperline_dst = job->dst->bytesperline;
+	int cmin = job->iparam;
+	int offset = (job->kernel - 1) / 2; // Calculo do valor do offset
 	int x, y, kx, ky, min, max;
-	long int pos, posk;
-	int offset = (kernel - 1) / 2; // Calculo do valor do offset
-	unsigned char threshold = 0.0;
-
-	unsigned char* datadst = (unsigned char*)dst->data;
-
-	if (src->height <= 0 || src->width <= 0 || src->height <= 0 || src->width <= 0 || src == NULL || dst == NULL)
-		return 0;
-	if (src->channels != 1 || dst->channels != 1)
-		return 0; // Verifica se as imagens têm os canais corretos
+	long int posk;
+	unsigned char threshold;
 
-	for (y = 0; y < height; y++)
+	for (y = y0; y < y1; y++)
 	{
 		for (x = 0; x < width; x++)
 		{
-			pos = y * bytesperline + x * channels;
-
 			max = 0;
 			min = 255;
 
+			// NxM vizinhos
 			for (ky = -offset; ky <= offset; ky++)
 			{
 				for (kx = -offset; kx <= offset; kx++)
 				{
 					if ((y + ky >= 0) && (y + ky < height) && (x + kx >= 0) && (x + kx < width))
 					{
-						posk = (y + ky) * bytesperline + (x + kx) * channels;
+						posk = (y + ky) * bytesperline_src + (x + kx);
 
 						if (datasrc[posk] > max)
 							max = datasrc[posk];
@@ -876,35 +1850,44 @@ int vc_gray_to_binary_midpoint(IVC* src, IVC* dst, int kernel)
 				}
 			}
 
-			threshold = (unsigned char)((float)(min + max) / (float)2);
+			if ((cmin >= 0) && ((max - min) < cmin))
+			{
+				threshold = (unsigned char)(float)levels / (float)2;
+			}
+			else
+			{
+				threshold = (unsigned char)((float)(min + max) / (float)2);
+			}
 
-			if (datasrc[pos] > threshold)
+			if (datasrc[y * bytesperline_src + x] > threshold)
 			{
-				datadst[pos] = 255;
+				datadst[y * bytesperline_dst + x] = 255;
 			}
 			else
 			{
-				datadst[pos] = 0;
+				datadst[y * bytesperline_dst + x] = 0;
 			}
 		}
 	}
+}
+
+int vc_gray_to_binary_midpoint(IVC* src, IVC* dst, int kernel)
+{
+	VCBANDJOB job = { src, dst, kernel, -1, 0.0f, NULL, NULL };
+
+	if (src == NULL || dst == NULL || src->height <= 0 || src->width <= 0 || src->data == NULL || dst->data == NULL)
+		return 0;
+	if (src->channels != 1 || dst->channels != 1)
+		return 0; // Verifica se as imagens têm os canais corretos
+
+	vc_parallel_for(vc_midpoint_band, &job, src->height, vc_parallel_nbands(src->height, VC_BAND_MIN));
+
 	return 1;
 }
 
 int vc_gray_to_binary_bernsen(IVC* src, IVC* dst, int kernel, int cmin)
 {
-	unsigned char* data = (unsigned char*)src->data;
-	unsigned char* data_dst = (unsigned char*)dst->data;
-	int width = src->width;
-	int height = src->height;
-	int levels = src->levels;
-	int bytesperline = src->bytesperline;
-	int channels = src->channels;
-	long int pos, posk;
-	int x, y, kx, ky;
-	unsigned char threshold;
-	int offset = (kernel - 1) / 2;
-	int max, min;
+	VCBANDJOB job = { src, dst, kernel, MAX(cmin, 0), 0.0f, NULL, NULL };
 
 	// Verificação de erros
 	if ((src->width) <= 0 || (src->height <= 0) || (src->data == NULL))
@@ -912,248 +1895,538 @@ int vc_gray_to_binary_bernsen(IVC* src, IVC* dst, int kernel, int cmin)
 	if (src->channels != 1)
 		return 0;
 
-	// Percorre todos os pixels da imagem de entrada
-	for (y = 0; y < height; y++)
+	// Percorre todos os pixels da imagem de entrada, por bandas de linhas
+	vc_parallel_for(vc_midpoint_band, &job, src->height, vc_parallel_nbands(src->height, VC_BAND_MIN));
+
+	return 1;
+}
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//                 IMAGEM INTEGRAL (SUMMED-AREA TABLE)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Primeira passagem da imagem integral: somas acumuladas de cada linha em [y0, y1[
+// job->aux : sum; job->aux2 : sqsum (ou NULL)
+static void vc_integral_rows_band(VCBANDJOB* job, int band, int y0, int y1)
+{
+	unsigned int* sum = (unsigned int*)job->aux;
+	unsigned long long* sqsum = (unsigned long long*)job->aux2;
+	int width = job->src->width;
+	int stride = width + 1;
+	int x, y;
+	unsigned int rowsum;
+	unsigned long long rowsqsum;
+	unsigned char* line;
+
+	for (y = y0; y < y1; y++)
 	{
+		line = job->src->data + y * job->src->bytesperline;
+
+		rowsum = 0;
+		sum[(y + 1) * stride] = 0;
 		for (x = 0; x < width; x++)
 		{
-			pos = y * bytesperline + x * channels;
-
-			max = 0;
-			min = 255;
+			rowsum += line[x];
+			sum[(y + 1) * stride + x + 1] = rowsum;
+		}
 
-			// NxM vizinhos
-			for (ky = -offset; ky <= offset; ky++)
+		if (sqsum != NULL)
+		{
+			rowsqsum = 0;
+			sqsum[(y + 1) * stride] = 0;
+			for (x = 0; x < width; x++)
 			{
-				for (kx = -offset; kx <= offset; kx++)
-				{
-					if ((y + ky >= 0) && (y + ky < height) && (x + kx >= 0) && (x + kx < width))
-					{
-						posk = (y + ky) * bytesperline + (x + kx) * channels;
-
-						if (data[posk] > max)
-							max = data[posk];
-						if (data[posk] < min)
-							min = data[posk];
-					}
-				}
+				rowsqsum += line[x] * line[x];
+				sqsum[(y + 1) * stride + x + 1] = rowsqsum;
 			}
+		}
+	}
+}
 
-			if ((max - min) < cmin)
-			{
-				threshold = (unsigned char)(float)levels / (float)2;
-			}
+// Segunda passagem: acumula as linhas de cima para baixo nas colunas [x0, x1[ da tabela
+static void vc_integral_cols_band(VCBANDJOB* job, int band, int x0, int x1)
+{
+	unsigned int* sum = (unsigned int*)job->aux;
+	unsigned long long* sqsum = (unsigned long long*)job->aux2;
+	int height = job->src->height;
+	int stride = job->src->width + 1;
+	int x, y;
+
+	for (y = 1; y < height; y++)
+	{
+		for (x = x0; x < x1; x++)
+			sum[(y + 1) * stride + x] += sum[y * stride + x];
+
+		if (sqsum != NULL)
+		{
+			for (x = x0; x < x1; x++)
+				sqsum[(y + 1) * stride + x] += sqsum[y * stride + x];
+		}
+	}
+}
+
+// Calcula as tabelas de soma e de soma dos quadrados de uma imagem em tons de cinzento
+// sum/sqsum : (width + 1) * (height + 1) elementos; a linha e a coluna 0 ficam a zero.
+//             sum[y * (width + 1) + x] = soma dos pixéis no rectângulo [0, x[ x [0, y[
+// sqsum pode ser NULL.
+// A tabela de somas usa aritmética de 32 bits sem sinal: pode dar a volta em imagens grandes,
+// mas a diferença de quatro cantos continua exacta para qualquer janela com soma inferior a 2^32
+// (janelas até 4104x4104 pixéis).
+// As somas por linha e a acumulação vertical são feitas em paralelo (por linhas e por colunas).
+int vc_gray_integral(IVC* src, unsigned int* sum, unsigned long long* sqsum)
+{
+	int width = src->width;
+	int height = src->height;
+	int stride = width + 1;
+	VCBANDJOB job = { src, NULL, 0, 0, 0.0f, sum, sqsum };
+
+	// Verificação de erros
+	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL) || (sum == NULL))
+		return 0;
+	if (src->channels != 1)
+		return 0;
+
+	memset(sum, 0, stride * sizeof(unsigned int));
+	if (sqsum != NULL)
+		memset(sqsum, 0, stride * sizeof(unsigned long long));
+
+	vc_parallel_for(vc_integral_rows_band, &job, height, vc_parallel_nbands(height, VC_BAND_MIN));
+	vc_parallel_for(vc_integral_cols_band, &job, stride, vc_parallel_nbands(stride, 4 * VC_BAND_MIN));
+
+	return 1;
+}
+
+// Soma dos pixéis no rectângulo [x0, x1[ x [y0, y1[
+static unsigned int vc_integral_window(unsigned int* sum, int stride, int x0, int y0, int x1, int y1)
+{
+	return sum[y1 * stride + x1] - sum[y0 * stride + x1] - sum[y1 * stride + x0] + sum[y0 * stride + x0];
+}
+
+static unsigned long long vc_integral_window_sq(unsigned long long* sqsum, int stride, int x0, int y0, int x1, int y1)
+{
+	return sqsum[y1 * stride + x1] - sqsum[y0 * stride + x1] - sqsum[y1 * stride + x0] + sqsum[y0 * stride + x0];
+}
+
+// Linhas [y, yend[ da limiarização local (job->iparam = sauvola, job->fparam = k)
+// job->aux : sum; job->aux2 : sqsum
+static void vc_local_stats_band(VCBANDJOB* job, int band, int ystart, int yend)
+{
+	unsigned char* datasrc = (unsigned char*)job->src->data;
+	unsigned char* datadst = (unsigned char*)job->dst->data;
+	int width = job->src->width;
+	int height = job->src->height;
+	int bytesperline_src = job->src->bytesperline;
+	int bytesperline_dst = job->dst->bytesperline;
+	int stride = width + 1;
+	int offset = MAX((job->kernel - 1) / 2, 0);
+	int sauvola = job->iparam;
+	float k = job->fparam;
+	unsigned int* sum = (unsigned int*)job->aux;
+	unsigned long long* sqsum = (unsigned long long*)job->aux2;
+	int x, y, x0, x1, y0, y1, counter;
+	double media, desvio, limiar;
+	unsigned char threshold;
+
+	for (y = ystart; y < yend; y++)
+	{
+		y0 = MAX(y - offset, 0);
+		y1 = MIN(y + offset, height - 1) + 1;
+
+		for (x = 0; x < width; x++)
+		{
+			x0 = MAX(x - offset, 0);
+			x1 = MIN(x + offset, width - 1) + 1;
+			counter = (x1 - x0) * (y1 - y0);
+
+			// Média e desvio padrão da vizinhança: var = E[X^2] - E[X]^2
+			media = (double)vc_integral_window(sum, stride, x0, y0, x1, y1) / counter;
+			desvio = (double)vc_integral_window_sq(sqsum, stride, x0, y0, x1, y1) / counter - media * media;
+			desvio = (desvio > 0.0) ? sqrt(desvio) : 0.0;
+
+			// Calcula o limiar
+			if (sauvola)
+				limiar = media * (1.0 + k * (desvio / 128.0 - 1.0));
 			else
-			{
-				threshold = (unsigned char)((float)(max + min) / (float)2);
-			}
+				limiar = media + k * desvio;
+			threshold = (unsigned char)CLAMP(limiar, 0.0, 255.0);
 
-			if (data[pos] > threshold)
+			if (datasrc[y * bytesperline_src + x] > threshold)
 			{
-				data_dst[pos] = 255;
+				datadst[y * bytesperline_dst + x] = 255;
 			}
 			else
 			{
-				data_dst[pos] = 0;
+				datadst[y * bytesperline_dst + x] = 0;
 			}
 		}
 	}
-	return 1;
 }
 
-int vc_gray_to_binary_niblack(IVC* src, IVC* dst, int kernel, float k)
+// Limiarização local com média e desvio padrão da vizinhança kernel x kernel (limitada à imagem)
+// sauvola = 0: Niblack -> T = media + k * desvio
+// sauvola = 1: Sauvola -> T = media * (1 + k * (desvio / R - 1)), R = 128
+static int vc_gray_to_binary_local_stats(IVC* src, IVC* dst, int kernel, float k, int sauvola)
 {
-	unsigned char* datasrc = (unsigned char*)src->data;
-	unsigned char* data_dst = (unsigned char*)dst->data;
 	int width = src->width;
 	int height = src->height;
-	int levels = src->levels;
-	int bytesperline = src->bytesperline;
-	int channels = src->channels;
-	long int pos, posk;
-	int x, y, counter, yy, xx, max, min;
-	unsigned char threshold;
-	int offset = (kernel - 1) / 2;
-	float media, desvio;
+	int stride = width + 1;
+	unsigned int* sum;
+	unsigned long long* sqsum;
+	VCBANDJOB job = { src, dst, kernel, sauvola, k, NULL, NULL };
 
 	// Verificação de erros
-	if ((src->width) <= 0 || (src->height <= 0) || (src->data == NULL))
+	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL))
 		return 0;
-	if (src->channels != 1)
+	if ((dst->data == NULL) || (src->width != dst->width) || (src->height != dst->height))
+		return 0;
+	if (src->channels != 1 || dst->channels != 1)
 		return 0;
 
-	// Percorre todos os pixels da imagem de entrada
-	for (y = 0; y < height; y++)
+	sum = (unsigned int*)vc_scratch_borrow(stride * (height + 1) * sizeof(unsigned int));
+	sqsum = (unsigned long long*)vc_scratch_borrow(stride * (height + 1) * sizeof(unsigned long long));
+	if (sum == NULL || sqsum == NULL)
 	{
-		for (x = 0; x < width; x++)
-		{
-			pos = y * bytesperline + x * channels;
+		vc_scratch_release(sum);
+		vc_scratch_release(sqsum);
+		return 0;
+	}
+
+	job.aux = sum;
+	job.aux2 = sqsum;
+
+	vc_gray_integral(src, sum, sqsum);
+	vc_parallel_for(vc_local_stats_band, &job, height, vc_parallel_nbands(height, VC_BAND_MIN));
 
-			max = datasrc[pos];
-			min = datasrc[pos];
+	vc_scratch_release(sum);
+	vc_scratch_release(sqsum);
 
-			media = 0.0f;
-			desvio = 0.0f;
+	return 1;
+}
+
+int vc_gray_to_binary_niblack(IVC* src, IVC* dst, int kernel, float k)
+{
+	return vc_gray_to_binary_local_stats(src, dst, kernel, k, 0);
+}
+
+int vc_gray_to_binary_sauvola(IVC* src, IVC* dst, int kernel, float k)
+{
+	return vc_gray_to_binary_local_stats(src, dst, kernel, k, 1);
+}
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//            REDUÇÃO DE RESOLUÇÃO (MÉDIA EM BLOCOS)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Linhas [y0, y1[ da redução: cada pixel de dst é a média (arredondada) de um bloco factor x factor
+// de src, canal a canal (job->kernel = factor, job->iparam = log2(factor))
+// As imagens a cores (3 canais) têm um ciclo próprio, com as três somas em registos
+static void vc_downsample_band(VCBANDJOB* job, int band, int y0, int y1)
+{
+	IVC* src = job->src;
+	IVC* dst = job->dst;
+	int factor = job->kernel;
+	int shift = 2 * job->iparam;
+	int round = (1 << shift) >> 1;
+	int channels = src->channels;
+	int width = dst->width;
+	int bytesperline = src->bytesperline;
+	int blocklen = factor * channels;
+	unsigned char* row;
+	unsigned char* p;
+	unsigned char* d;
+	int x, y, c, i, j, s0, s1, s2;
 
-			// Calcula a média
-			for (counter = 0, yy = -offset; yy <= offset; yy++)
+	for (y = y0; y < y1; y++)
+	{
+		row = src->data + (size_t)y * factor * bytesperline;
+		d = dst->data + y * dst->bytesperline;
+
+		if (channels == 3)
+		{
+			for (x = 0; x < width; x++, row += blocklen, d += 3)
 			{
-				for (xx = -offset; xx <= offset; xx++)
+				s0 = s1 = s2 = 0;
+				for (j = 0, p = row; j < factor; j++, p += bytesperline)
 				{
-					if ((y + yy >= 0) && (y + yy < height) && (x + xx >= 0) && (x + xx < width))
+					for (i = 0; i < blocklen; i += 3)
 					{
-						posk = (y + yy) * bytesperline + (x + xx) * channels;
-						media += (float)datasrc[posk];
-						counter++;
+						s0 += p[i];
+						s1 += p[i + 1];
+						s2 += p[i + 2];
 					}
 				}
+				d[0] = (unsigned char)((s0 + round) >> shift);
+				d[1] = (unsigned char)((s1 + round) >> shift);
+				d[2] = (unsigned char)((s2 + round) >> shift);
 			}
-			media /= counter;
-
-			for (counter = 0, yy = -offset; yy <= offset; yy++)
+		}
+		else
+		{
+			for (x = 0; x < width; x++, row += blocklen, d += channels)
 			{
-				for (xx = -offset; xx <= offset; xx++)
+				for (c = 0; c < channels; c++)
 				{
-					if ((y + yy >= 0) && (y + yy < height) && (x + xx >= 0) && (x + xx < width))
+					s0 = 0;
+					for (j = 0, p = row + c; j < factor; j++, p += bytesperline)
 					{
-						posk = (y + yy) * bytesperline + (x + xx) * channels;
-						desvio += powf(((float)datasrc[posk]) - media, 2);
-
-						counter++;
+						for (i = 0; i < blocklen; i += channels)
+							s0 += p[i];
 					}
+					d[c] = (unsigned char)((s0 + round) >> shift);
 				}
 			}
+		}
+	}
+}
 
-			desvio = sqrtf(desvio / counter);
+// Reduz a resolução de src por factor (1, 2, 4 ou 8) em cada direcção, com a média de cada bloco
+// dst tem de ter width / factor x height / factor pixéis e os mesmos canais (as últimas
+// width % factor colunas e height % factor linhas de src são ignoradas).
+int vc_image_downsample(IVC* src, IVC* dst, int factor)
+{
+	int log2factor;
+	VCBANDJOB job = { src, dst, factor, 0, 0.0f, NULL, NULL };
 
-			// Calcula o limiar
-			threshold = (unsigned char)(media + k * desvio);
+	// Verificação de erros
+	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL) || (dst->data == NULL))
+		return 0;
+	if ((factor != 1) && (factor != 2) && (factor != 4) && (factor != 8))
+		return 0;
+	if ((dst->width != src->width / factor) || (dst->height != src->height / factor) || (dst->channels != src->channels))
+		return 0;
+	if (dst->width <= 0 || dst->height <= 0)
+		return 0;
 
-			if (datasrc[pos] > threshold)
-			{
-				data_dst[pos] = 255;
-			}
-			else
-			{
-				data_dst[pos] = 0;
-			}
-		}
-	}
+	for (log2factor = 0; (1 << log2factor) < factor; log2factor++);
+	job.iparam = log2factor;
+
+	vc_parallel_for(vc_downsample_band, &job, dst->height, vc_parallel_nbands(dst->height, VC_BAND_MIN));
 
 	return 1;
 }
 
-int vc_binary_dilate(IVC* src, IVC* dst, int kernel)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//      MORFOLOGIA: MÁXIMO/MÍNIMO DESLIZANTE (VAN HERK/GIL-WERMAN)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// O elemento estruturante quadrado kernel x kernel é separável: um máximo (dilatação)
+// ou mínimo (erosão) horizontal seguido de um vertical. Cada passagem divide a linha
+// em blocos de tamanho w = kernel e combina um sufixo do bloco actual com um
+// prefixo do bloco seguinte, pelo que custa 3 comparações por pixel seja qual for o kernel.
+// A janela de x é [x - kernel / 2, x + (kernel - 1) / 2], com a âncora no centro como no OpenCV
+// (cv::getStructuringElement(MORPH_RECT) com âncora por omissão): num kernel par há mais um pixel
+// antes do que depois, p.ex. 48 cobre [x - 24, x + 23].
+// Os pixéis fora da imagem são ignorados (equivale a preencher com 0 no máximo e 255 no mínimo).
+
+// Pixéis da janela antes (lo) e depois (hi) do centro; w = lo + hi + 1 (1 se kernel <= 0)
+#define VC_MORPH_LO(kernel) MAX((kernel) / 2, 0)
+#define VC_MORPH_HI(kernel) MAX(((kernel) - 1) / 2, 0)
+
+#define VC_MORPH_OP(ismax, a, b) ((ismax) ? MAX(a, b) : MIN(a, b))
+
+// Passagem horizontal das linhas [y0, y1[ (janela de w pixéis, lo antes do centro)
+// line : buffer com width + w bytes
+// hbuf : buffer com w bytes
+static void vc_morph_rows(unsigned char* datasrc, int bytesperline_src, unsigned char* datadst, int bytesperline_dst,
+	int width, int y0, int y1, int lo, int w, int ismax, unsigned char pad, const unsigned char* lut,
+	unsigned char* line, unsigned char* hbuf)
 {
-	unsigned char* datasrc = (unsigned char*)src->data;
-	unsigned char* datadst = (unsigned char*)dst->data;
-	int width = src->width;
-	int height = src->height;
-	int bytesperline = src->bytesperline;
-	int channels = src->channels;
-	long int pos, posk;
-	int x, y, kx, ky;
-	int offset = (kernel - 1) / 2;
-	int pixel;
+	int x, y, b, j, n;
+	unsigned char* src;
+	unsigned char* dst;
+	unsigned char g;
 
-	if (src->width <= 0 || src->height <= 0 || src->data == NULL)
-		return 0;
-	if (src->channels != 1 || dst->channels != 1)
-		return 0;
+	// Rebordos do buffer de linha são constantes
+	memset(line, pad, lo);
+	memset(line + lo + width, pad, w - lo);
 
-	for (y = 0; y < height; y++)
+	for (y = y0; y < y1; y++)
 	{
+		src = datasrc + y * bytesperline_src;
+		dst = datadst + y * bytesperline_dst;
+
 		for (x = 0; x < width; x++)
+			line[lo + x] = lut[src[x]];
+
+		for (b = 0; b < width; b += w)
 		{
-			pos = y * bytesperline + x * channels;
+			n = MIN(w, width - b);
 
-			pixel = 0; // Definindo inicialmente como preto
+			// Sufixo do bloco [b, b + w[
+			hbuf[w - 1] = line[b + w - 1];
+			for (j = w - 2; j >= 0; j--)
+				hbuf[j] = VC_MORPH_OP(ismax, line[b + j], hbuf[j + 1]);
 
-			for (ky = -offset; ky <= offset; ky++)
-			{ // percorre cada linha do kernel
-				for (kx = -offset; kx <= offset; kx++)
-				{ // percorre cada coluna do kernel
-					if ((y + ky >= 0) && (y + ky < height) && (x + kx >= 0) && (x + kx < width))
-					{														  // verifica se a posição é válida
-						posk = (y + ky) * bytesperline + (x + kx) * channels; // calcula a posição do pixel na imagem
-
-						if (datasrc[posk] == 255)
-						{
-							// Se algum pixel na vizinhança for branco, marca o pixel central como branco
-							pixel = 255;
-							break; // Sair do loop interno, pois já encontramos um pixel branco
-						}
-					}
-				}
-				if (pixel == 255)
-					break; // Sair do loop externo se já marcamos o pixel central como branco
+			// Prefixo do bloco seguinte
+			dst[b] = hbuf[0];
+			g = line[b + w];
+			for (j = 1; j < n; j++)
+			{
+				dst[b + j] = VC_MORPH_OP(ismax, hbuf[j], g);
+				g = VC_MORPH_OP(ismax, g, line[b + w + j]);
 			}
+		}
+	}
+}
+
+// Passagem vertical das colunas [x0, x1[ (janela de w linhas, lo antes do centro)
+// hblock : buffer com w * (x1 - x0) bytes
+// grow   : buffer com x1 - x0 bytes
+// padrow : buffer com x1 - x0 bytes
+static void vc_morph_cols(unsigned char* datasrc, int bytesperline_src, unsigned char* datadst, int bytesperline_dst,
+	int height, int x0, int x1, int lo, int w, int ismax, unsigned char pad,
+	unsigned char* hblock, unsigned char* grow, unsigned char* padrow)
+{
+	int ncols = x1 - x0;
+	int x, b, j, n, i;
+	unsigned char* p;
+	unsigned char* h;
+	unsigned char* hnext;
+	unsigned char* dst;
+
+	memset(padrow, pad, ncols);
+
+	// Linha i da imagem com rebordo (i em [0, height + w[)
+#define VC_MORPH_ROW(i) ((((i) < lo) || ((i) >= height + lo)) ? padrow : datasrc + ((i) - lo) * bytesperline_src + x0)
+
+	for (b = 0; b < height; b += w)
+	{
+		n = MIN(w, height - b);
+
+		// Sufixo do bloco [b, b + w[
+		h = hblock + (w - 1) * ncols;
+		p = VC_MORPH_ROW(b + w - 1);
+		memcpy(h, p, ncols);
+		for (j = w - 2; j >= 0; j--)
+		{
+			h = hblock + j * ncols;
+			hnext = h + ncols;
+			p = VC_MORPH_ROW(b + j);
+			for (x = 0; x < ncols; x++)
+				h[x] = VC_MORPH_OP(ismax, p[x], hnext[x]);
+		}
 
-			// Atribuindo o valor ao pixel na imagem de destino
-			datadst[pos] = pixel;
+		// Prefixo do bloco seguinte
+		memcpy(datadst + b * bytesperline_dst + x0, hblock, ncols);
+		memcpy(grow, VC_MORPH_ROW(b + w), ncols);
+		for (j = 1; j < n; j++)
+		{
+			h = hblock + j * ncols;
+			dst = datadst + (b + j) * bytesperline_dst + x0;
+			for (x = 0; x < ncols; x++)
+				dst[x] = VC_MORPH_OP(ismax, h[x], grow[x]);
+
+			i = b + w + j;
+			p = VC_MORPH_ROW(i);
+			for (x = 0; x < ncols; x++)
+				grow[x] = VC_MORPH_OP(ismax, grow[x], p[x]);
 		}
 	}
 
-	return 1;
+#undef VC_MORPH_ROW
 }
 
-int vc_binary_erode(IVC* src, IVC* dst, int kernel)
+// Dados partilhados pelas bandas de uma operação morfológica
+typedef struct
+{
+	unsigned char* tmp;			// Resultado da passagem horizontal (width x height)
+	unsigned char* scratch;		// Buffers de trabalho: scratchsize bytes por banda
+	int scratchsize;
+	int ismax;
+	unsigned char pad;
+	unsigned char lut[256];
+} VCMORPHJOB;
+
+// Passagem horizontal das linhas [y0, y1[
+static void vc_morph_rows_band(VCBANDJOB* job, int band, int y0, int y1)
+{
+	VCMORPHJOB* m = (VCMORPHJOB*)job->aux;
+	int width = job->src->width;
+	int lo = VC_MORPH_LO(job->kernel);
+	int w = lo + VC_MORPH_HI(job->kernel) + 1;
+	unsigned char* line = m->scratch + band * m->scratchsize;
+	unsigned char* hbuf = line + width + w;
+
+	vc_morph_rows(job->src->data, job->src->bytesperline, m->tmp, width, width, y0, y1, lo, w, m->ismax, m->pad, m->lut, line, hbuf);
+}
+
+// Passagem vertical das colunas [x0, x1[
+static void vc_morph_cols_band(VCBANDJOB* job, int band, int x0, int x1)
+{
+	VCMORPHJOB* m = (VCMORPHJOB*)job->aux;
+	int lo = VC_MORPH_LO(job->kernel);
+	int w = lo + VC_MORPH_HI(job->kernel) + 1;
+	unsigned char* hblock = m->scratch + band * m->scratchsize;
+	unsigned char* grow = hblock + w * (x1 - x0);
+	unsigned char* padrow = grow + (x1 - x0);
+
+	vc_morph_cols(m->tmp, job->src->width, job->dst->data, job->dst->bytesperline, job->src->height, x0, x1, lo, w, m->ismax, m->pad, hblock, grow, padrow);
+}
+
+// Dilatação (ismax = 1) ou erosão (ismax = 0) com elemento estruturante quadrado
+// binary = 1: a entrada é binarizada (dilatação: 255 é objecto; erosão: 0 é fundo)
+// A passagem horizontal é feita em paralelo por bandas de linhas e a vertical por bandas de colunas.
+static int vc_morphology(IVC* src, IVC* dst, int kernel, int ismax, int binary)
 {
-	unsigned char* datasrc = (unsigned char*)src->data;
-	unsigned char* datadst = (unsigned char*)dst->data;
 	int width = src->width;
 	int height = src->height;
-	int bytesperline = src->bytesperline;
-	int channels = src->channels;
-	long int pos, posk;
-	int x, y, kx, ky;
-	int offset = (kernel - 1) / 2;
-	int pixel;
+	int w = VC_MORPH_LO(kernel) + VC_MORPH_HI(kernel) + 1;
+	int nrows = vc_parallel_nbands(height, VC_BAND_MIN);
+	int ncols = vc_parallel_nbands(width, 4 * VC_BAND_MIN);
+	int maxcols = (width + ncols - 1) / ncols;
+	VCMORPHJOB m;
+	VCBANDJOB job = { src, dst, kernel, 0, 0.0f, &m, NULL };
+	int i;
 
+	// Verificação de erros
 	if (src->width <= 0 || src->height <= 0 || src->data == NULL)
 		return 0;
+	if (dst->data == NULL || src->width != dst->width || src->height != dst->height)
+		return 0;
 	if (src->channels != 1 || dst->channels != 1)
 		return 0;
 
-	for (y = 0; y < height; y++)
+	m.ismax = ismax;
+	m.pad = ismax ? 0 : 255;
+	for (i = 0; i < 256; i++)
 	{
-		for (x = 0; x < width; x++)
-		{
-			pos = y * bytesperline + x * channels;
+		if (!binary)
+			m.lut[i] = (unsigned char)i;
+		else if (ismax)
+			m.lut[i] = (i == 255) ? 255 : 0;
+		else
+			m.lut[i] = (i == 0) ? 0 : 255;
+	}
 
-			pixel = 255; // Definindo inicialmente como branco
+	// Imagem intermédia e buffers de trabalho de cada banda:
+	// linhas -> line (width + w) e hbuf (w); colunas -> hblock (w * maxcols), grow e padrow (maxcols)
+	m.scratchsize = MAX(width + 2 * w, (w + 2) * maxcols);
+	m.tmp = (unsigned char*)vc_scratch_borrow(width * height + m.scratchsize * MAX(nrows, ncols));
+	if (m.tmp == NULL)
+		return 0;
+	m.scratch = m.tmp + width * height;
 
-			for (ky = -offset; ky <= offset; ky++)
-			{
-				for (kx = -offset; kx <= offset; kx++)
-				{
-					if ((y + ky >= 0) && (y + ky < height) && (x + kx >= 0) && (x + kx < width))
-					{
-						posk = (y + ky) * bytesperline + (x + kx) * channels;
-
-						if (datasrc[posk] == 0)
-						{
-							// Se algum pixel na vizinhança for zero, marca o pixel central como zero
-							pixel = 0;
-							break; // Sair do loop interno, pois já encontramos um pixel zero
-						}
-					}
-				}
-				if (pixel == 0)
-					break; // Sair do loop externo se já marcamos o pixel central como zero
-			}
+	vc_parallel_for(vc_morph_rows_band, &job, height, nrows);
+	vc_parallel_for(vc_morph_cols_band, &job, width, ncols);
 
-			// Atribuindo o valor ao pixel na imagem de destino
-			datadst[pos] = pixel;
-		}
-	}
+	vc_scratch_release(m.tmp);
 
 	return 1;
 }
 
+int vc_binary_dilate(IVC* src, IVC* dst, int kernel)
+{
+	return vc_morphology(src, dst, kernel, 1, 1);
+}
+
+int vc_binary_erode(IVC* src, IVC* dst, int kernel)
+{
+	return vc_morphology(src, dst, kernel, 0, 1);
+}
+
 int vc_binary_open(IVC* src, IVC* dst, int kernel1, int kernel2)
 {
-	IVC* tmp = vc_image_new(src->width, src->height, src->channels, src->levels);
+	IVC* tmp = vc_image_borrow(src->width, src->height, src->channels, src->levels);
 	if (tmp == NULL)
 		return 0;
 
@@ -1175,7 +2448,7 @@ int vc_binary_open(IVC* src, IVC* dst, int kernel1, int kernel2)
 
 int vc_binary_close(IVC* src, IVC* dst, int kernel)
 {
-	IVC* tmp = vc_image_new(src->width, src->height, src->channels, src->levels);
+	IVC* tmp = vc_image_borrow(src->width, src->height, src->channels, src->levels);
 	if (tmp == NULL)
 		return 0;
 
@@ -1197,370 +2470,1837 @@ int vc_binary_close(IVC* src, IVC* dst, int kernel)
 
 int vc_gray_dilate(IVC* src, IVC* dst, int kernel)
 {
-	unsigned char* datasrc = (unsigned char*)src->data;
-	unsigned char* datadst = (unsigned char*)dst->data;
-	int width = src->width;
-	int height = src->height;
-	int bytesperline = src->bytesperline;
-	int channels = src->channels;
-	long int pos, posk;
-	int x, y, kx, ky;
-	int offset = (kernel - 1) / 2;
-	int pixel, max;
+	return vc_morphology(src, dst, kernel, 1, 0);
+}
 
-	if (src->width <= 0 || src->height <= 0 || src->data == NULL)
+int vc_gray_erode(IVC* src, IVC* dst, int kernel)
+{
+	return vc_morphology(src, dst, kernel, 0, 0);
+}
+
+int vc_binary_to_gray(IVC* src, IVC* dst)
+{
+	if (src == NULL || dst == NULL)
 		return 0;
+
+	// Verifica se a imagem de entrada está em binário e se a de saída tem apenas um canal
 	if (src->channels != 1 || dst->channels != 1)
 		return 0;
 
+	int width = src->width;
+	int height = src->height;
+	int x, y;
+
 	for (y = 0; y < height; y++)
 	{
 		for (x = 0; x < width; x++)
 		{
-			pos = y * bytesperline + x * channels;
-
-			pixel = 0;
+			// Obtém o valor do pixel na imagem binária
+			unsigned char binary_value = src->data[y * src->bytesperline + x];
 
-			for (ky = -offset; ky <= offset; ky++)
-			{
-				for (kx = -offset; kx <= offset; kx++)
-				{
-					if ((y + ky >= 0) && (y + ky < height) && (x + kx >= 0) && (x + kx < width))
-					{
-						posk = (y + ky) * bytesperline + (x + kx) * channels;
+			// Define o valor de cinza na imagem de destino
+			dst->data[y * dst->bytesperline + x] = binary_value;
+		}
+	}
 
-						if (datasrc[posk] > pixel)
-						{
-							pixel = datasrc[posk];
-						}
-					}
-				}
+	return 1;
+}
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//         MÁSCARAS BINÁRIAS COM 1 BIT POR PIXEL (BVC)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Cada linha da máscara é um vector de palavras de 64 bits: o pixel x é o bit x % 64 da palavra x / 64.
+// As operações lógicas, a contagem de pixéis e a morfologia trabalham sobre palavras inteiras, ou seja,
+// 64 pixéis de cada vez e com 1/8 da memória das imagens binárias de 1 byte por pixel.
+// Os bits a seguir a width na última palavra de cada linha estão sempre a 0.
+
+#define VC_MASK_BITS 64
+
+// Palavra com os bits [0, width % 64[ da última palavra de uma linha (todos se width for múltiplo de 64)
+static unsigned long long vc_mask_lastword(int width)
+{
+	return (width % VC_MASK_BITS) ? ((1ULL << (width % VC_MASK_BITS)) - 1) : ~0ULL;
+}
+
+// Número de bits a 1 numa palavra
+static int vc_mask_popcount(unsigned long long v)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(v);
+#else
+	v = v - ((v >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Posição do bit a 1 menos significativo (v != 0)
+static int vc_mask_ctz(unsigned long long v)
+{
+#if defined(__GNUC__)
+	return __builtin_ctzll(v);
+#else
+	// Sequência de De Bruijn: os 6 bits de cima do produto identificam o bit isolado
+	static const unsigned char posicao[64] = {
+		0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4, 62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+		63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11, 46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6
+	};
+	return posicao[((v & (0 - v)) * 0x03F79D71B4CB0A89ULL) >> 58];
+#endif
+}
+
+// Alocar uma máscara com todos os pixéis a 0
+BVC* vc_mask_new(int width, int height)
+{
+	BVC* mask;
+	size_t size;
+
+	if ((width <= 0) || (height <= 0))
+		return NULL;
+
+	mask = (BVC*)malloc(sizeof(BVC));
+	if (mask == NULL)
+		return NULL;
+
+	mask->width = width;
+	mask->height = height;
+	mask->wordsperline = (width + VC_MASK_BITS - 1) / VC_MASK_BITS;
+
+	size = (size_t)mask->wordsperline * height * sizeof(unsigned long long);
+	mask->data = (unsigned long long*)vc_aligned_malloc(size);
+	if (mask->data == NULL)
+	{
+		free(mask);
+		return NULL;
+	}
+	memset(mask->data, 0, size);
+
+	return mask;
+}
+
+// Libertar uma máscara
+BVC* vc_mask_free(BVC* mask)
+{
+	if (mask != NULL)
+	{
+		vc_aligned_free(mask->data);
+		free(mask);
+		mask = NULL;
+	}
+
+	return mask;
+}
+
+// Converte uma imagem binária (1 canal) para máscara: pixéis diferentes de 0 -> 1
+// Cada grupo de 8 pixéis é lido como uma palavra de 64 bits (little-endian) e reduzido a 8 bits.
+int vc_mask_from_binary(IVC* src, BVC* dst)
+{
+	int width = src->width;
+	int height = src->height;
+	int x, y, i, n;
+	unsigned char* p;
+	unsigned long long* q;
+	unsigned long long v, word;
+
+	// Verificação de erros
+	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL))
+		return 0;
+	if ((dst == NULL) || (dst->data == NULL) || (dst->width != width) || (dst->height != height))
+		return 0;
+	if (src->channels != 1)
+		return 0;
+
+	for (y = 0; y < height; y++)
+	{
+		p = src->data + y * src->bytesperline;
+		q = dst->data + (size_t)y * dst->wordsperline;
+
+		for (x = 0; x < width; x += VC_MASK_BITS)
+		{
+			n = MIN(VC_MASK_BITS, width - x);
+			word = 0;
+
+			for (i = 0; i + 8 <= n; i += 8)
+			{
+				memcpy(&v, p + x + i, 8);
+
+				// Bit 0 de cada byte = OR dos seus 8 bits; depois junta os 8 bits 0 num byte
+				v |= v >> 4;
+				v |= v >> 2;
+				v |= v >> 1;
+				v &= 0x0101010101010101ULL;
+				word |= ((v * 0x0102040810204080ULL) >> 56) << i;
+			}
+			for (; i < n; i++)
+				word |= (unsigned long long)(p[x + i] != 0) << i;
+
+			q[x / VC_MASK_BITS] = word;
+		}
+	}
+
+	return 1;
+}
+
+// Converte uma máscara para imagem binária (1 canal): 1 -> 255, 0 -> 0
+// Cada byte da máscara (8 pixéis) é expandido para 8 bytes com uma multiplicação.
+int vc_mask_to_binary(BVC* src, IVC* dst)
+{
+	int width = src->width;
+	int height = src->height;
+	int x, y, i, n;
+	unsigned long long* p;
+	unsigned char* q;
+	unsigned long long v, word;
+
+	// Verificação de erros
+	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL))
+		return 0;
+	if ((dst == NULL) || (dst->data == NULL) || (dst->width != width) || (dst->height != height))
+		return 0;
+	if (dst->channels != 1)
+		return 0;
+
+	for (y = 0; y < height; y++)
+	{
+		p = src->data + (size_t)y * src->wordsperline;
+		q = dst->data + y * dst->bytesperline;
+
+		for (x = 0; x < width; x += VC_MASK_BITS)
+		{
+			n = MIN(VC_MASK_BITS, width - x);
+			word = p[x / VC_MASK_BITS];
+
+			for (i = 0; i + 8 <= n; i += 8)
+			{
+				// Bit j do byte -> byte j com o bit na posição j; depois cada byte não nulo -> 0xFF
+				v = ((word >> i) & 0xFF) * 0x0101010101010101ULL;
+				v &= 0x8040201008040201ULL;
+				v = ((v + 0x7F7F7F7F7F7F7F7FULL) & 0x8080808080808080ULL) >> 7;
+				v *= 0xFF;
+				memcpy(q + x + i, &v, 8);
 			}
+			for (; i < n; i++)
+				q[x + i] = ((word >> i) & 1) ? 255 : 0;
+		}
+	}
+
+	return 1;
+}
+
+// Verifica se duas máscaras têm as mesmas dimensões
+static int vc_mask_same_size(BVC* a, BVC* b)
+{
+	if ((a == NULL) || (b == NULL) || (a->data == NULL) || (b->data == NULL))
+		return 0;
+
+	return (a->width > 0) && (a->height > 0) && (a->width == b->width) && (a->height == b->height);
+}
+
+// dst = a AND b (dst pode ser a ou b)
+int vc_mask_and(BVC* a, BVC* b, BVC* dst)
+{
+	size_t i, n;
+
+	// Verificação de erros
+	if (!vc_mask_same_size(a, b) || !vc_mask_same_size(a, dst))
+		return 0;
+
+	n = (size_t)a->wordsperline * a->height;
+	for (i = 0; i < n; i++)
+		dst->data[i] = a->data[i] & b->data[i];
+
+	return 1;
+}
+
+// dst = a OR b (dst pode ser a ou b)
+int vc_mask_or(BVC* a, BVC* b, BVC* dst)
+{
+	size_t i, n;
+
+	// Verificação de erros
+	if (!vc_mask_same_size(a, b) || !vc_mask_same_size(a, dst))
+		return 0;
+
+	n = (size_t)a->wordsperline * a->height;
+	for (i = 0; i < n; i++)
+		dst->data[i] = a->data[i] | b->data[i];
+
+	return 1;
+}
+
+// dst = NOT src (dst pode ser src); os bits depois de width continuam a 0
+int vc_mask_not(BVC* src, BVC* dst)
+{
+	unsigned long long last = vc_mask_lastword(src->width);
+	int wpl = src->wordsperline;
+	int x, y;
+	unsigned long long* p;
+	unsigned long long* q;
+
+	// Verificação de erros
+	if (!vc_mask_same_size(src, dst))
+		return 0;
+
+	for (y = 0; y < src->height; y++)
+	{
+		p = src->data + (size_t)y * wpl;
+		q = dst->data + (size_t)y * wpl;
+
+		for (x = 0; x < wpl; x++)
+			q[x] = ~p[x];
+		q[wpl - 1] &= last;
+	}
+
+	return 1;
+}
+
+// Número de pixéis a 1 (-1 se a máscara for inválida)
+long long vc_mask_count(BVC* mask)
+{
+	size_t i, n;
+	long long count = 0;
+
+	// Verificação de erros
+	if ((mask == NULL) || (mask->data == NULL) || (mask->width <= 0) || (mask->height <= 0))
+		return -1;
+
+	n = (size_t)mask->wordsperline * mask->height;
+	for (i = 0; i < n; i++)
+		count += vc_mask_popcount(mask->data[i]);
+
+	return count;
+}
+
+// Morfologia sobre máscaras: a janela [x - lo, x + hi] (lo = kernel / 2, hi = (kernel - 1) / 2,
+// w = lo + hi + 1) é separável e tem a mesma âncora que em vc_morphology.
+// Em cada direcção, o OR (dilatação) ou AND (erosão) de w vizinhos obtém-se por duplicação:
+// t(x) = combinação de [x, x + span[, com span = 1, 2, 4, ... <= w, e no fim
+// out(x) = t(x - lo) op t(x + hi - span + 1), que cobre exactamente [x - lo, x + hi].
+// São O(log w) operações por palavra (64 pixéis) em cada passagem. Os pixéis fora da máscara
+// valem 0 na dilatação e 1 na erosão, pelo que o resultado é igual ao de vc_binary_dilate/erode;
+// t é calculado também para os lo pixéis (ou linhas) antes do início, que cobrem parte da máscara.
+
+#define VC_MASK_OP(ismax, a, b) ((ismax) ? ((a) | (b)) : ((a) & (b)))
+
+// Palavra i de uma linha deslocada n pixéis: out(x) = row(x + n); fora da linha vale fill
+static unsigned long long vc_mask_shifted(unsigned long long* row, int nwords, int i, int n, unsigned long long fill)
+{
+	int q = (n >= 0) ? n / VC_MASK_BITS : -((-n + VC_MASK_BITS - 1) / VC_MASK_BITS);
+	int b = n - q * VC_MASK_BITS;
+	int j = i + q;
+	unsigned long long lo = ((j >= 0) && (j < nwords)) ? row[j] : fill;
+	unsigned long long hi;
+
+	if (b == 0)
+		return lo;
+
+	hi = ((j + 1 >= 0) && (j + 1 < nwords)) ? row[j + 1] : fill;
+
+	return (lo >> b) | (hi << (VC_MASK_BITS - b));
+}
+
+// Dados partilhados pelas bandas de uma operação morfológica sobre máscaras
+typedef struct
+{
+	BVC* src;
+	BVC* dst;
+	unsigned long long* tmp;		// Passagem horizontal: lo linhas de rebordo + height linhas (wordsperline palavras)
+	unsigned long long* line;		// Buffer de trabalho: padwords + wordsperline palavras por banda
+	int padwords;					// Palavras de rebordo à esquerda de cada linha (>= lo bits)
+	int lo, hi;						// Pixéis da janela antes e depois do centro
+	int ismax;
+} VCMASKJOB;
+
+// Passagem horizontal das linhas [y0, y1[ (src -> tmp)
+static void vc_mask_rows_band(VCBANDJOB* job, int band, int y0, int y1)
+{
+	VCMASKJOB* m = (VCMASKJOB*)job->aux;
+	int wpl = m->src->wordsperline;
+	int pad = m->padwords;
+	int nwords = pad + wpl;
+	int lo = m->lo;
+	int hi = m->hi;
+	int w = lo + hi + 1;
+	unsigned long long fill = m->ismax ? 0 : ~0ULL;
+	unsigned long long last = vc_mask_lastword(m->src->width);
+	unsigned long long* t = m->line + (size_t)band * nwords;
+	unsigned long long* out;
+	int x, y, span;
+
+	for (y = y0; y < y1; y++)
+	{
+		// Linha com rebordo à esquerda; os bits depois de width também ficam fora da máscara
+		for (x = 0; x < pad; x++)
+			t[x] = fill;
+		memcpy(t + pad, m->src->data + (size_t)y * wpl, wpl * sizeof(unsigned long long));
+		t[nwords - 1] = (t[nwords - 1] & last) | (fill & ~last);
+		out = m->tmp + (size_t)(lo + y) * wpl;
+
+		// Duplicação no próprio buffer: cada palavra só lê palavras à sua direita, ainda por actualizar
+		for (span = 1; 2 * span <= w; span *= 2)
+		{
+			for (x = 0; x < nwords; x++)
+				t[x] = VC_MASK_OP(m->ismax, t[x], vc_mask_shifted(t, nwords, x, span, fill));
+		}
+
+		for (x = 0; x < wpl; x++)
+			out[x] = VC_MASK_OP(m->ismax, vc_mask_shifted(t, nwords, pad + x, -lo, fill), vc_mask_shifted(t, nwords, pad + x, hi - span + 1, fill));
+		out[wpl - 1] &= last;
+	}
+}
+
+// Passagem vertical das palavras [x0, x1[ de cada linha (tmp -> dst)
+static void vc_mask_cols_band(VCBANDJOB* job, int band, int x0, int x1)
+{
+	VCMASKJOB* m = (VCMASKJOB*)job->aux;
+	int wpl = m->src->wordsperline;
+	int lo = m->lo;
+	int hi = m->hi;
+	int nrows = lo + m->src->height;
+	int w = lo + hi + 1;
+	unsigned long long fill = m->ismax ? 0 : ~0ULL;
+	unsigned long long* t;
+	unsigned long long* out;
+	int x, y, span, yb;
+
+	// Linhas de rebordo acima da máscara
+	for (y = 0; y < lo; y++)
+	{
+		t = m->tmp + (size_t)y * wpl;
+		for (x = x0; x < x1; x++)
+			t[x] = fill;
+	}
+
+	// Duplicação no próprio buffer, linha a linha de cima para baixo
+	for (span = 1; 2 * span <= w; span *= 2)
+	{
+		for (y = 0; y < nrows; y++)
+		{
+			t = m->tmp + (size_t)y * wpl;
+			for (x = x0; x < x1; x++)
+				t[x] = VC_MASK_OP(m->ismax, t[x], (y + span < nrows) ? t[x + (size_t)span * wpl] : fill);
+		}
+	}
+
+	// A linha y da saída combina as linhas y - lo e y + hi - span + 1, ou seja, y e
+	// y + lo + hi - span + 1 do buffer com rebordo
+	for (y = 0; y < m->src->height; y++)
+	{
+		t = m->tmp + (size_t)y * wpl;
+		out = m->dst->data + (size_t)y * wpl;
+		yb = y + lo + hi - span + 1;
+
+		if (yb < nrows)
+		{
+			for (x = x0; x < x1; x++)
+				out[x] = VC_MASK_OP(m->ismax, t[x], t[x + (size_t)(yb - y) * wpl]);
+		}
+		else
+		{
+			for (x = x0; x < x1; x++)
+				out[x] = VC_MASK_OP(m->ismax, t[x], fill);
+		}
+	}
+}
+
+// Dilatação (ismax = 1) ou erosão (ismax = 0) de uma máscara com elemento estruturante quadrado
+// src e dst podem ser a mesma máscara.
+static int vc_mask_morphology(BVC* src, BVC* dst, int kernel, int ismax)
+{
+	int wpl = src->wordsperline;
+	int height = src->height;
+	int nrows = vc_parallel_nbands(height, VC_BAND_MIN);
+	int ncols = vc_parallel_nbands(wpl, 8);
+	VCMASKJOB m;
+	VCBANDJOB job = { NULL, NULL, kernel, 0, 0.0f, &m, NULL };
+
+	// Verificação de erros
+	if (!vc_mask_same_size(src, dst))
+		return 0;
+
+	m.src = src;
+	m.dst = dst;
+	m.lo = VC_MORPH_LO(kernel);
+	m.hi = VC_MORPH_HI(kernel);
+	m.padwords = (m.lo + VC_MASK_BITS - 1) / VC_MASK_BITS;
+	m.ismax = ismax;
+
+	m.tmp = (unsigned long long*)vc_scratch_borrow(((size_t)wpl * (m.lo + height) + (size_t)(m.padwords + wpl) * nrows) * sizeof(unsigned long long));
+	if (m.tmp == NULL)
+		return 0;
+	m.line = m.tmp + (size_t)wpl * (m.lo + height);
+
+	vc_parallel_for(vc_mask_rows_band, &job, height, nrows);
+	vc_parallel_for(vc_mask_cols_band, &job, wpl, ncols);
+
+	vc_scratch_release(m.tmp);
+
+	return 1;
+}
+
+int vc_mask_dilate(BVC* src, BVC* dst, int kernel)
+{
+	return vc_mask_morphology(src, dst, kernel, 1);
+}
+
+int vc_mask_erode(BVC* src, BVC* dst, int kernel)
+{
+	return vc_mask_morphology(src, dst, kernel, 0);
+}
+
+// Máscara temporária emprestada da reserva de buffers (devolver com vc_scratch_release(tmp->data))
+static int vc_mask_borrow(BVC* src, BVC* tmp)
+{
+	*tmp = *src;
+	tmp->data = (unsigned long long*)vc_scratch_borrow((size_t)src->wordsperline * src->height * sizeof(unsigned long long));
+
+	return tmp->data != NULL;
+}
+
+int vc_mask_open(BVC* src, BVC* dst, int kernel1, int kernel2)
+{
+	BVC tmp;
+	int ok;
+
+	// Verificação de erros
+	if (!vc_mask_same_size(src, dst))
+		return 0;
+	if (!vc_mask_borrow(src, &tmp))
+		return 0;
+
+	ok = vc_mask_erode(src, &tmp, kernel1) && vc_mask_dilate(&tmp, dst, kernel2);
+
+	vc_scratch_release(tmp.data);
+	return ok;
+}
+
+int vc_mask_close(BVC* src, BVC* dst, int kernel)
+{
+	BVC tmp;
+	int ok;
+
+	// Verificação de erros
+	if (!vc_mask_same_size(src, dst))
+		return 0;
+	if (!vc_mask_borrow(src, &tmp))
+		return 0;
+
+	ok = vc_mask_dilate(src, &tmp, kernel) && vc_mask_erode(&tmp, dst, kernel);
+
+	vc_scratch_release(tmp.data);
+	return ok;
+}
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//          ETIQUETAGEM DE BLOBS (UNION-FIND, 32 BITS)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Procura a raiz de uma etiqueta provisória, comprimindo o caminho
+static int vc_uf_find(int* parent, int i)
+{
+	int root = i;
+	int next;
+
+	while (parent[root] != root)
+		root = parent[root];
+
+	while (parent[i] != root)
+	{
+		next = parent[i];
+		parent[i] = root;
+		i = next;
+	}
+
+	return root;
+}
+
+// Une as classes de a e b; a raiz é sempre a menor etiqueta
+static int vc_uf_union(int* parent, int a, int b)
+{
+	a = vc_uf_find(parent, a);
+	b = vc_uf_find(parent, b);
+
+	if (a < b)
+	{
+		parent[b] = a;
+		return a;
+	}
+
+	parent[a] = b;
+	return b;
+}
+
+// Cria a lista de blobs (objectos) com etiquetas 1..n
+static OVC* vc_blob_list_new(int n)
+{
+	OVC* blobs;
+	int a;
+
+	if (n <= 0)
+		return NULL;
+
+	blobs = (OVC*)calloc(n, sizeof(OVC));
+	if (blobs == NULL)
+		return NULL;
+
+	for (a = 0; a < n; a++)
+		blobs[a].label = a + 1;
+
+	return blobs;
+}
+
+// Liberta uma lista de blobs devolvida pelas funções de etiquetagem (equivale a free)
+// As listas são do chamador e não vêm da reserva de buffers: num ciclo sem alocações usar
+// vc_rle_blob_labelling_into, que escreve num vector OVC do chamador
+OVC* vc_blob_list_free(OVC* blobs)
+{
+	free(blobs);
+
+	return NULL;
+}
+
+// Acumuladores de um blob, preenchidos numa única passagem pela imagem de etiquetas
+typedef struct {
+	long long sumx, sumy;		// Somas das coordenadas (centro de massa)
+	int xmin, ymin, xmax, ymax;	// Caixa delimitadora
+	int area;
+	int perimeter;
+} VCBLOBACC;
+
+static void vc_blob_acc_init(VCBLOBACC* acc, int n, int width, int height)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		acc[i].sumx = 0;
+		acc[i].sumy = 0;
+		acc[i].xmin = width - 1;
+		acc[i].ymin = height - 1;
+		acc[i].xmax = 0;
+		acc[i].ymax = 0;
+		acc[i].area = 0;
+		acc[i].perimeter = 0;
+	}
+}
+
+// Acrescenta o pixel (x, y) ao blob; contorno = pelo menos um dos 4 vizinhos não pertence ao blob
+static void vc_blob_acc_add(VCBLOBACC* acc, int x, int y, int contorno)
+{
+	acc->area++;
+	acc->sumx += x;
+	acc->sumy += y;
+	if (acc->xmin > x)
+		acc->xmin = x;
+	if (acc->ymin > y)
+		acc->ymin = y;
+	if (acc->xmax < x)
+		acc->xmax = x;
+	if (acc->ymax < y)
+		acc->ymax = y;
+	acc->perimeter += contorno;
+}
+
+static void vc_blob_acc_finish(VCBLOBACC* acc, OVC* blob)
+{
+	// Bounding Box
+	blob->x = acc->xmin;
+	blob->y = acc->ymin;
+	blob->width = (acc->xmax - acc->xmin) + 1;
+	blob->height = (acc->ymax - acc->ymin) + 1;
+
+	blob->area = acc->area;
+	blob->perimeter = acc->perimeter;
+
+	// Centro de Gravidade
+	blob->xc = (int)(acc->sumx / MAX(acc->area, 1));
+	blob->yc = (int)(acc->sumy / MAX(acc->area, 1));
+}
+
+// Etiquetagem em duas passagens (vizinhança-8) com union-find sobre etiquetas provisórias
+// labels : width * height inteiros; recebe etiquetas 1..n (0 = fundo)
+// blobs  : se não for NULL, recebe a lista de blobs com área, caixa delimitadora, centro de massa
+//          e perímetro, calculados durante a segunda passagem
+// Os rebordos da imagem são considerados fundo.
+// As etiquetas finais são consecutivas e seguem a ordem do primeiro pixel de cada blob (varrimento em linhas).
+// Devolve o número de blobs, ou -1 se não houver memória.
+static int vc_binary_blob_labelling_uf(IVC* src, int* labels, OVC** blobs)
+{
+	unsigned char* datasrc = (unsigned char*)src->data;
+	int width = src->width;
+	int height = src->height;
+	int bytesperline = src->bytesperline;
+	int x, y, i, n;
+	int label = 1;
+	int* parent;
+	int* lx;
+	int* lprev;
+	int* lnext;
+	unsigned char* line;
+	VCBLOBACC* acc = NULL;
+
+	if (blobs != NULL)
+		*blobs = NULL;
+
+	// Limpa os rebordos da imagem de etiquetas
+	memset(labels, 0, width * sizeof(int));
+	memset(labels + (height - 1) * width, 0, width * sizeof(int));
+	for (y = 1; y < height - 1; y++)
+	{
+		labels[y * width] = 0;
+		labels[y * width + width - 1] = 0;
+	}
+
+	if (width < 3 || height < 3)
+		return 0;
+
+	// Na vizinhança-8, cada bloco 2x2 cria no máximo uma etiqueta provisória
+	parent = (int*)vc_scratch_borrow((((width + 1) / 2) * ((height + 1) / 2) + 1) * sizeof(int));
+	if (parent == NULL)
+		return -1;
+	parent[0] = 0;
+
+	// Primeira passagem
+	// Kernel:
+	// A B C
+	// D X
+	for (y = 1; y < height - 1; y++)
+	{
+		line = datasrc + y * bytesperline;
+		lx = labels + y * width;
+		lprev = lx - width;
+
+		for (x = 1; x < width - 1; x++)
+		{
+			if (line[x] == 0)
+			{
+				lx[x] = 0;
+			}
+			else if (lprev[x] != 0) // B (A, C e D, se marcados, já estão ligados a B)
+			{
+				lx[x] = lprev[x];
+			}
+			else if (lprev[x + 1] != 0) // C
+			{
+				if (lprev[x - 1] != 0)
+					lx[x] = vc_uf_union(parent, lprev[x + 1], lprev[x - 1]);
+				else if (lx[x - 1] != 0)
+					lx[x] = vc_uf_union(parent, lprev[x + 1], lx[x - 1]);
+				else
+					lx[x] = lprev[x + 1];
+			}
+			else if (lprev[x - 1] != 0) // A
+			{
+				lx[x] = lprev[x - 1];
+			}
+			else if (lx[x - 1] != 0) // D
+			{
+				lx[x] = lx[x - 1];
+			}
+			else
+			{
+				parent[label] = label;
+				lx[x] = label;
+				label++;
+			}
+		}
+	}
+
+	// Etiquetas finais consecutivas: como a raiz é a menor etiqueta da classe, parent[i] < i já foi resolvido
+	for (n = 0, i = 1; i < label; i++)
+	{
+		if (parent[i] == i)
+			parent[i] = ++n;
+		else
+			parent[i] = parent[parent[i]];
+	}
+
+	if (blobs == NULL || n == 0)
+	{
+		// Segunda passagem
+		for (y = 1; y < height - 1; y++)
+		{
+			lx = labels + y * width;
+			for (x = 1; x < width - 1; x++)
+				lx[x] = parent[lx[x]];
+		}
+
+		vc_scratch_release(parent);
+
+		return n;
+	}
+
+	*blobs = vc_blob_list_new(n);
+	acc = (VCBLOBACC*)vc_scratch_borrow((n + 1) * sizeof(VCBLOBACC));
+	if (*blobs == NULL || acc == NULL)
+	{
+		*blobs = vc_blob_list_free(*blobs);
+		vc_scratch_release(acc);
+		vc_scratch_release(parent);
+		return -1;
+	}
+	vc_blob_acc_init(acc, n + 1, width, height);
+
+	// Segunda passagem, com extracção de informação dos blobs
+	// Os 4 vizinhos de um pixel de um blob, se marcados, pertencem ao mesmo blob: basta testar o fundo
+	for (y = 1; y < height - 1; y++)
+	{
+		lx = labels + y * width;
+		lprev = lx - width;
+		lnext = lx + width;
+		for (x = 1; x < width - 1; x++)
+		{
+			if (lx[x] != 0)
+			{
+				lx[x] = parent[lx[x]];
+				vc_blob_acc_add(&acc[lx[x]], x, y, (lx[x - 1] == 0) || (lx[x + 1] == 0) || (lprev[x] == 0) || (lnext[x] == 0));
+			}
+		}
+	}
+
+	for (i = 0; i < n; i++)
+		vc_blob_acc_finish(&acc[i + 1], &(*blobs)[i]);
+
+	vc_scratch_release(acc);
+	vc_scratch_release(parent);
+
+	return n;
+}
+
+// Etiquetagem de blobs com etiquetas de 32 bits (sem limite de 254 etiquetas)
+// src		: Imagem binária de entrada
+// labels	: Array com width * height inteiros (irá conter as etiquetas, 0 = fundo)
+// nlabels	: Endereço de memória de uma variável, onde será armazenado o número de etiquetas encontradas.
+// OVC*		: Retorna um array de estruturas de blobs (objectos), com etiquetas 1..nlabels. É necessário libertar posteriormente esta memória.
+// A informação dos blobs (área, caixa delimitadora, centro de massa e perímetro) é calculada durante
+// a etiquetagem, pelo que não é preciso chamar vc_binary_blob_info32.
+OVC* vc_binary_blob_labelling32(IVC* src, int* labels, int* nlabels)
+{
+	OVC* blobs;
+	int n;
+
+	*nlabels = 0;
+
+	// Verificação de erros
+	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL) || (labels == NULL))
+		return NULL;
+	if (src->channels != 1)
+		return NULL;
+
+	n = vc_binary_blob_labelling_uf(src, labels, &blobs);
+	if (n <= 0)
+		return NULL;
+
+	*nlabels = n;
+
+	return blobs;
+}
+
+// Etiquetagem de blobs
+// src		: Imagem binária de entrada
+// dst		: Imagem grayscale (irá conter as etiquetas)
+// nlabels	: Endereço de memória de uma variável, onde será armazenado o número de etiquetas encontradas.
+// OVC*		: Retorna um array de estruturas de blobs (objectos), com respectivas etiquetas. É necessário libertar posteriormente esta memória.
+// A imagem de etiquetas tem 8 bits: com mais de 255 blobs as etiquetas acima de 255 ficam saturadas em 255.
+// Para imagens com muitos blobs usar vc_binary_blob_labelling32.
+OVC* vc_binary_blob_labelling(IVC* src, IVC* dst, int* nlabels) // identifica os blobs apenas
+{
+	unsigned char* datadst = (unsigned char*)dst->data;
+	int width = src->width;
+	int height = src->height;
+	int bytesperline = dst->bytesperline;
+	int x, y, n;
+	int* labels;
+
+	*nlabels = 0;
+
+	// Verificação de erros
+	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL))
+		return NULL;
+	if ((src->width != dst->width) || (src->height != dst->height) || (src->channels != dst->channels))
+		return NULL;
+	if (src->channels != 1)
+		return NULL;
+
+	labels = (int*)vc_scratch_borrow(width * height * sizeof(int));
+	if (labels == NULL)
+		return NULL;
+
+	n = vc_binary_blob_labelling_uf(src, labels, NULL);
+
+#ifdef VC_DEBUG
+	if (n > 255)
+		printf("WARNING -> vc_binary_blob_labelling():\n\t%d labels do not fit in 8 bits. Use vc_binary_blob_labelling32().\n", n);
+#endif
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+			datadst[y * bytesperline + x] = (unsigned char)MIN(labels[y * width + x], 255);
+	}
+
+	vc_scratch_release(labels);
 
-			datadst[pos] = pixel;
+	// Se não há blobs
+	if (n <= 0)
+		return NULL;
+
+	*nlabels = n;
+
+	return vc_blob_list_new(n);
+}
+
+// Informação dos blobs numa única passagem pela imagem de etiquetas (8 bits)
+int vc_binary_blob_info(IVC* src, OVC* blobs, int nblobs) // os blobs acima indentificados sao um corpo
+{
+	unsigned char* data = (unsigned char*)src->data;
+	int width = src->width;
+	int height = src->height;
+	int bytesperline = src->bytesperline;
+	int channels = src->channels;
+	int x, y, i, label;
+	long int pos;
+	int indice[256];		// Etiqueta -> índice do blob (-1 se não pertence à lista)
+	VCBLOBACC acc[256];
+	VCBLOBACC vazio;		// Blobs com etiquetas que não cabem em 8 bits
+
+	// Verificacao de erros
+	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL))
+		return 0;
+	if (channels != 1)
+		return 0;
+	if ((nblobs > 0) && (blobs == NULL))
+		return 0;
+
+	for (i = 0; i < 256; i++)
+		indice[i] = -1;
+	for (i = 0; i < nblobs; i++)
+	{
+		if ((blobs[i].label >= 0) && (blobs[i].label < 256) && (indice[blobs[i].label] < 0))
+			indice[blobs[i].label] = i;
+	}
+	vc_blob_acc_init(acc, 256, width, height);
+	vc_blob_acc_init(&vazio, 1, width, height);
+
+	for (y = 1; y < height - 1; y++)
+	{
+		for (x = 1; x < width - 1; x++)
+		{
+			pos = y * bytesperline + x * channels;
+			label = data[pos];
+
+			if (indice[label] >= 0)
+			{
+				// Perímetro
+				// Se pelo menos um dos quatro vizinhos não pertence ao mesmo label, então é um pixel de contorno
+				vc_blob_acc_add(&acc[label], x, y, (data[pos - 1] != label) || (data[pos + 1] != label) || (data[pos - bytesperline] != label) || (data[pos + bytesperline] != label));
+			}
 		}
 	}
 
+	for (i = 0; i < nblobs; i++)
+	{
+		if ((blobs[i].label >= 0) && (blobs[i].label < 256))
+			vc_blob_acc_finish(&acc[blobs[i].label], &blobs[i]);
+		else
+			vc_blob_acc_finish(&vazio, &blobs[i]);
+	}
+
 	return 1;
 }
 
-int vc_binary_to_gray(IVC* src, IVC* dst)
+// Informação dos blobs numa única passagem pela imagem de etiquetas de 32 bits (width * height inteiros)
+int vc_binary_blob_info32(int* labels, int width, int height, OVC* blobs, int nblobs)
 {
-	if (src == NULL || dst == NULL)
+	int x, y, i, label, maxlabel;
+	long int pos;
+	int* indice;			// Etiqueta -> índice do blob (-1 se não pertence à lista)
+	VCBLOBACC* acc;
+
+	// Verificacao de erros
+	if ((width <= 0) || (height <= 0) || (labels == NULL))
+		return 0;
+	if (nblobs <= 0)
+		return 1;
+	if (blobs == NULL)
 		return 0;
 
-	// Verifica se a imagem de entrada está em binário e se a de saída tem apenas um canal
-	if (src->channels != 1 || dst->channels != 1)
+	for (maxlabel = 0, i = 0; i < nblobs; i++)
+		maxlabel = MAX(maxlabel, blobs[i].label);
+
+	indice = (int*)vc_scratch_borrow((maxlabel + 1) * sizeof(int));
+	acc = (VCBLOBACC*)vc_scratch_borrow(nblobs * sizeof(VCBLOBACC));
+	if (indice == NULL || acc == NULL)
+	{
+		vc_scratch_release(indice);
+		vc_scratch_release(acc);
 		return 0;
+	}
+
+	for (i = 0; i <= maxlabel; i++)
+		indice[i] = -1;
+	for (i = nblobs - 1; i >= 0; i--)
+	{
+		if (blobs[i].label > 0)
+			indice[blobs[i].label] = i;
+	}
+	vc_blob_acc_init(acc, nblobs, width, height);
+
+	for (y = 1; y < height - 1; y++)
+	{
+		for (x = 1; x < width - 1; x++)
+		{
+			pos = y * width + x;
+			label = labels[pos];
+
+			if ((label > 0) && (label <= maxlabel) && (indice[label] >= 0))
+			{
+				vc_blob_acc_add(&acc[indice[label]], x, y, (labels[pos - 1] != label) || (labels[pos + 1] != label) || (labels[pos - width] != label) || (labels[pos + width] != label));
+			}
+		}
+	}
 
+	for (i = 0; i < nblobs; i++)
+	{
+		if ((blobs[i].label > 0) && (blobs[i].label <= maxlabel))
+			vc_blob_acc_finish(&acc[indice[blobs[i].label]], &blobs[i]);
+		else
+			vc_blob_acc_finish(&acc[i], &blobs[i]);
+	}
+
+	vc_scratch_release(indice);
+	vc_scratch_release(acc);
+
+	return 1;
+}
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//       ETIQUETAGEM DE BLOBS SOBRE CORRIDAS (RUN-LENGTH)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Uma máscara RLE guarda, para cada linha, as corridas de pixéis de objecto [x0, x1[. Nas máscaras
+// esparsas (muito fundo e poucos objectos grandes) há muito menos corridas do que pixéis, e a
+// etiquetagem e a informação dos blobs passam a custar O(corridas) em vez de O(pixéis).
+
+// Capacidade inicial de corridas por linha
+#define VC_RLE_RUNS_PER_LINE 4
+
+// Alocar uma máscara RLE vazia
+// A lista de corridas cresce quando é preciso e é reaproveitada pelas conversões seguintes.
+RLEVC* vc_rle_new(int width, int height)
+{
+	RLEVC* rle;
+
+	if ((width <= 0) || (height <= 0))
+		return NULL;
+
+	rle = (RLEVC*)malloc(sizeof(RLEVC));
+	if (rle == NULL)
+		return NULL;
+
+	rle->width = width;
+	rle->height = height;
+	rle->nruns = 0;
+	rle->maxruns = VC_RLE_RUNS_PER_LINE * height;
+	rle->runs = (RVC*)malloc(rle->maxruns * sizeof(RVC));
+	rle->rowstart = (int*)calloc(height + 1, sizeof(int));
+	if ((rle->runs == NULL) || (rle->rowstart == NULL))
+	{
+		free(rle->runs);
+		free(rle->rowstart);
+		free(rle);
+		return NULL;
+	}
+
+	return rle;
+}
+
+// Libertar uma máscara RLE
+RLEVC* vc_rle_free(RLEVC* rle)
+{
+	if (rle != NULL)
+	{
+		free(rle->runs);
+		free(rle->rowstart);
+		free(rle);
+		rle = NULL;
+	}
+
+	return rle;
+}
+
+// Acrescenta a corrida [x0, x1[ da linha y (duplica a capacidade se estiver cheia)
+static int vc_rle_push(RLEVC* rle, int x0, int x1, int y)
+{
+	RVC* runs;
+	RVC* r;
+
+	if (rle->nruns == rle->maxruns)
+	{
+		runs = (RVC*)realloc(rle->runs, 2 * (size_t)rle->maxruns * sizeof(RVC));
+		if (runs == NULL)
+			return 0;
+		rle->runs = runs;
+		rle->maxruns *= 2;
+	}
+
+	r = &rle->runs[rle->nruns++];
+	r->x0 = x0;
+	r->x1 = x1;
+	r->y = y;
+	r->label = 0;
+
+	return 1;
+}
+
+// Converte uma imagem binária (1 canal) para corridas: pixéis diferentes de 0 são objecto
+// O fundo e o interior das corridas são percorridos 8 pixéis de cada vez.
+int vc_rle_from_binary(IVC* src, RLEVC* dst)
+{
 	int width = src->width;
 	int height = src->height;
-	int x, y;
+	int x, y, x0;
+	unsigned char* p;
+	unsigned long long v;
+
+	// Verificação de erros
+	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL))
+		return 0;
+	if ((dst == NULL) || (dst->width != width) || (dst->height != height))
+		return 0;
+	if (src->channels != 1)
+		return 0;
+
+	dst->nruns = 0;
 
 	for (y = 0; y < height; y++)
 	{
-		for (x = 0; x < width; x++)
+		p = src->data + y * src->bytesperline;
+		dst->rowstart[y] = dst->nruns;
+
+		x = 0;
+		while (x < width)
 		{
-			// Obtém o valor do pixel na imagem binária
-			unsigned char binary_value = src->data[y * width + x];
+			// Fundo: salta palavras a zero
+			while (x + 8 <= width)
+			{
+				memcpy(&v, p + x, 8);
+				if (v != 0)
+					break;
+				x += 8;
+			}
+			while ((x < width) && (p[x] == 0))
+				x++;
+			if (x >= width)
+				break;
+
+			// Objecto: salta palavras sem nenhum byte a zero
+			x0 = x;
+			while (x + 8 <= width)
+			{
+				memcpy(&v, p + x, 8);
+				if (((v - 0x0101010101010101ULL) & ~v & 0x8080808080808080ULL) != 0)
+					break;
+				x += 8;
+			}
+			while ((x < width) && (p[x] != 0))
+				x++;
 
-			// Define o valor de cinza na imagem de destino
-			dst->data[y * width + x] = binary_value;
+			if (!vc_rle_push(dst, x0, x, y))
+				return 0;
 		}
 	}
+	dst->rowstart[height] = dst->nruns;
 
 	return 1;
 }
 
-// Etiquetagem de blobs
-// src		: Imagem bin�ria de entrada
-// dst		: Imagem grayscale (ir� conter as etiquetas)
-// nlabels	: Endere�o de mem�ria de uma vari�vel, onde ser� armazenado o n�mero de etiquetas encontradas.
-// OVC*		: Retorna um array de estruturas de blobs (objectos), com respectivas etiquetas. � necess�rio libertar posteriormente esta mem�ria.
-OVC* vc_binary_blob_labelling(IVC* src, IVC* dst, int* nlabels) // identifica os blobs apenas
+// Converte uma máscara de 1 bit por pixel para corridas
+// Os inícios e fins das corridas são as mudanças de bit de cada palavra, visitadas uma a uma.
+int vc_rle_from_mask(BVC* src, RLEVC* dst)
 {
-	unsigned char* datasrc = (unsigned char*)src->data;
-	unsigned char* datadst = (unsigned char*)dst->data;
 	int width = src->width;
 	int height = src->height;
-	int bytesperline = src->bytesperline;
-	int channels = src->channels;
-	int x, y, a, b;
-	long int i, size;
-	long int posX, posA, posB, posC, posD;
-	int labeltable[256] = { 0 };
-	int labelarea[256] = { 0 };
-	int label = 1; // Etiqueta inicial.
-	int num, tmplabel;
-	OVC* blobs; // Apontador para array de blobs (objectos) que ser� retornado desta fun��o.
-
-	// Verifica��o de erros
+	int i, y, x0, inrun;
+	unsigned long long* p;
+	unsigned long long word, change, carry;
+
+	// Verificação de erros
 	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL))
 		return 0;
-	if ((src->width != dst->width) || (src->height != dst->height) || (src->channels != dst->channels))
+	if ((dst == NULL) || (dst->width != width) || (dst->height != height))
+		return 0;
+
+	dst->nruns = 0;
+
+	for (y = 0; y < height; y++)
+	{
+		p = src->data + (size_t)y * src->wordsperline;
+		dst->rowstart[y] = dst->nruns;
+
+		inrun = 0;
+		x0 = 0;
+		carry = 0;
+		for (i = 0; i < src->wordsperline; i++)
+		{
+			word = p[i];
+			change = word ^ ((word << 1) | carry);
+			carry = word >> (VC_MASK_BITS - 1);
+
+			for (; change != 0; change &= change - 1)
+			{
+				if (!inrun)
+				{
+					x0 = i * VC_MASK_BITS + vc_mask_ctz(change);
+				}
+				else if (!vc_rle_push(dst, x0, i * VC_MASK_BITS + vc_mask_ctz(change), y))
+				{
+					return 0;
+				}
+				inrun = !inrun;
+			}
+		}
+
+		// Corrida que chega ao fim da linha
+		if (inrun && !vc_rle_push(dst, x0, width, y))
+			return 0;
+	}
+	dst->rowstart[height] = dst->nruns;
+
+	return 1;
+}
+
+// Acrescenta a corrida [x0, x1[ da linha y ao blob, com contorno pixéis de contorno
+static void vc_blob_acc_add_run(VCBLOBACC* acc, int x0, int x1, int y, int contorno)
+{
+	int n = x1 - x0;
+
+	acc->area += n;
+	acc->sumx += (long long)(x0 + x1 - 1) * n / 2;
+	acc->sumy += (long long)y * n;
+	if (acc->xmin > x0)
+		acc->xmin = x0;
+	if (acc->ymin > y)
+		acc->ymin = y;
+	if (acc->xmax < x1 - 1)
+		acc->xmax = x1 - 1;
+	if (acc->ymax < y)
+		acc->ymax = y;
+	acc->perimeter += contorno;
+}
+
+// Etiquetagem (vizinhança-8) e informação dos blobs sobre as corridas de uma máscara RLE
+// O resultado é igual ao de vc_binary_blob_labelling32 sobre a mesma máscara: os rebordos da imagem
+// são fundo, as etiquetas 1..nlabels seguem a ordem do primeiro pixel de cada blob e a área, caixa
+// delimitadora, centro de massa e perímetro são os mesmos. Cada corrida recebe em label a etiqueta
+// do seu blob (0 nas corridas que estão só no rebordo).
+// Duas corridas de linhas seguidas pertencem ao mesmo blob se [x0 - 1, x1] de uma tocar na outra.
+// Um pixel é de contorno se for uma ponta da corrida ou se lhe faltar o vizinho de cima ou de baixo.
+// Se list não for NULL a lista é criada com n blobs e devolvida em *list (libertar com vc_blob_list_free);
+// senão são escritos os primeiros min(n, maxblobs) blobs em blobs. Devolve n (número de blobs) ou -1 se erro.
+static int vc_rle_labelling(RLEVC* rle, OVC* blobs, int maxblobs, OVC** list)
+{
+	int width = rle->width;
+	int height = rle->height;
+	int y, i, j, k, m, n, x0, x1, a, b, nup, ndown, jd;
+	int label = 1;
+	int inner;
+	int* parent;
+	RVC* row;
+	RVC* up;
+	RVC* down;
+	VCBLOBACC* acc;
+
+	// Verificação de erros
+	if ((rle->width <= 0) || (rle->height <= 0) || (rle->runs == NULL))
+		return -1;
+
+	for (i = 0; i < rle->nruns; i++)
+		rle->runs[i].label = 0;
+
+	if (width < 3 || height < 3 || rle->nruns == 0)
+		return 0;
+
+	// Cada corrida cria no máximo uma etiqueta provisória
+	parent = (int*)vc_scratch_borrow((rle->nruns + 1) * sizeof(int));
+	if (parent == NULL)
+		return -1;
+	parent[0] = 0;
+
+	// Corridas da linha y limitadas ao interior [1, width - 1[ (as linhas 0 e height - 1 são rebordo)
+#define VC_RLE_ROW(y) (rle->runs + rle->rowstart[y])
+#define VC_RLE_COUNT(y) ((((y) <= 0) || ((y) >= height - 1)) ? 0 : rle->rowstart[(y) + 1] - rle->rowstart[y])
+#define VC_RLE_X0(r) MAX((r)->x0, 1)
+#define VC_RLE_X1(r) MIN((r)->x1, width - 1)
+
+	// Primeira passagem: etiquetas provisórias e equivalências com as corridas da linha de cima
+	for (y = 1; y < height - 1; y++)
+	{
+		row = VC_RLE_ROW(y);
+		up = VC_RLE_ROW(y - 1);
+		nup = VC_RLE_COUNT(y - 1);
+		j = 0;
+
+		for (i = 0; i < VC_RLE_COUNT(y); i++)
+		{
+			x0 = VC_RLE_X0(&row[i]);
+			x1 = VC_RLE_X1(&row[i]);
+			if (x0 >= x1)
+				continue;
+
+			// Corridas de cima que tocam [x0 - 1, x1]; as que acabam antes não tocam as corridas seguintes
+			while ((j < nup) && (VC_RLE_X1(&up[j]) < x0))
+				j++;
+			for (k = j; (k < nup) && (VC_RLE_X0(&up[k]) <= x1); k++)
+			{
+				if (up[k].label == 0)
+					continue;
+				if (row[i].label == 0)
+					row[i].label = up[k].label;
+				else
+					row[i].label = vc_uf_union(parent, row[i].label, up[k].label);
+			}
+
+			if (row[i].label == 0)
+			{
+				parent[label] = label;
+				row[i].label = label;
+				label++;
+			}
+		}
+	}
+
+	// Etiquetas finais consecutivas (como em vc_binary_blob_labelling_uf)
+	for (n = 0, i = 1; i < label; i++)
+	{
+		if (parent[i] == i)
+			parent[i] = ++n;
+		else
+			parent[i] = parent[parent[i]];
+	}
+
+	if (n == 0)
+	{
+		vc_scratch_release(parent);
+		return 0;
+	}
+
+	if (list != NULL)
+	{
+		blobs = vc_blob_list_new(n);
+		maxblobs = n;
+	}
+	acc = (VCBLOBACC*)vc_scratch_borrow((n + 1) * sizeof(VCBLOBACC));
+	if ((list != NULL && blobs == NULL) || acc == NULL)
+	{
+		if (list != NULL)
+			vc_blob_list_free(blobs);
+		vc_scratch_release(acc);
+		vc_scratch_release(parent);
+		return -1;
+	}
+	vc_blob_acc_init(acc, n + 1, width, height);
+
+	// Segunda passagem: etiquetas finais e informação dos blobs
+	// Os pixéis interiores [x0 + 1, x1 - 1[ que têm vizinho em cima e em baixo não são contorno:
+	// são as intersecções com as corridas de cima e, dentro delas, com as de baixo.
+	for (y = 1; y < height - 1; y++)
+	{
+		row = VC_RLE_ROW(y);
+		up = VC_RLE_ROW(y - 1);
+		nup = VC_RLE_COUNT(y - 1);
+		down = VC_RLE_ROW(y + 1);
+		ndown = VC_RLE_COUNT(y + 1);
+		j = 0;
+		jd = 0;
+
+		for (i = 0; i < VC_RLE_COUNT(y); i++)
+		{
+			if (row[i].label == 0)
+				continue;
+			row[i].label = parent[row[i].label];
+			x0 = VC_RLE_X0(&row[i]);
+			x1 = VC_RLE_X1(&row[i]);
+
+			inner = 0;
+			while ((j < nup) && (VC_RLE_X1(&up[j]) <= x0 + 1))
+				j++;
+			for (k = j; (k < nup) && (VC_RLE_X0(&up[k]) < x1 - 1); k++)
+			{
+				a = MAX(x0 + 1, VC_RLE_X0(&up[k]));
+				b = MIN(x1 - 1, VC_RLE_X1(&up[k]));
+
+				while ((jd < ndown) && (VC_RLE_X1(&down[jd]) <= a))
+					jd++;
+				for (m = jd; (m < ndown) && (VC_RLE_X0(&down[m]) < b); m++)
+					inner += MAX(MIN(b, VC_RLE_X1(&down[m])) - MAX(a, VC_RLE_X0(&down[m])), 0);
+			}
+
+			vc_blob_acc_add_run(&acc[row[i].label], x0, x1, y, (x1 - x0) - inner);
+		}
+	}
+
+#undef VC_RLE_ROW
+#undef VC_RLE_COUNT
+#undef VC_RLE_X0
+#undef VC_RLE_X1
+
+	for (i = 0; i < MIN(n, maxblobs); i++)
+	{
+		blobs[i].label = i + 1;
+		vc_blob_acc_finish(&acc[i + 1], &blobs[i]);
+	}
+
+	vc_scratch_release(acc);
+	vc_scratch_release(parent);
+
+	if (list != NULL)
+		*list = blobs;
+
+	return n;
+}
+
+// OVC*		: Lista de blobs, a libertar com vc_blob_list_free (NULL se não houver blobs)
+OVC* vc_rle_blob_labelling(RLEVC* rle, int* nlabels)
+{
+	OVC* blobs = NULL;
+	int n = vc_rle_labelling(rle, NULL, 0, &blobs);
+
+	*nlabels = MAX(n, 0);
+
+	return (n > 0) ? blobs : NULL;
+}
+
+// Como vc_rle_blob_labelling, mas os blobs são escritos em blobs[0 .. maxblobs - 1] (sem alocar a lista)
+// Devolve o número de blobs, que pode ser maior do que maxblobs (só os primeiros maxblobs são escritos;
+// as corridas ficam todas etiquetadas), ou -1 em caso de erro. Com maxblobs = 0, blobs pode ser NULL.
+int vc_rle_blob_labelling_into(RLEVC* rle, OVC* blobs, int maxblobs)
+{
+	// Verificação de erros
+	if ((maxblobs < 0) || ((blobs == NULL) && (maxblobs > 0)))
+		return -1;
+
+	return vc_rle_labelling(rle, blobs, maxblobs, NULL);
+}
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//              SEGUIMENTO DE BLOBS ENTRE FRAMES
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+// Cada blob visto é associado a uma trajectória com um identificador persistente. Em cada frame a
+// posição de cada trajectória é prevista a partir da velocidade (centro e caixa deslocados), e os
+// blobs são associados às previsões por ordem crescente de distância ao centro previsto, desde que
+// a caixa prevista toque a do blob ou o centro esteja a menos de maxdist pixéis. Os blobs que sobram
+// criam trajectórias novas; as trajectórias sem blob durante mais de maxmissed frames são apagadas.
+// Cada trajectória gera um único evento de passagem pela linha de contagem: quando o centro fica a
+// tolerancia pixéis da linha ou salta de um lado para o outro entre duas observações, e o blob é aceite
+// pelo chamador (qualifica). Enquanto o blob não for aceite o evento fica pendente: volta a ser avaliado
+// em cada observação em que o centro ainda esteja a tolerancia pixéis da linha.
+
+// Criar um seguidor com espaço para maxtracks trajectórias
+// linha: coordenada y da linha de contagem
+TRACKVC* vc_tracker_new(int maxtracks, int linha, int tolerancia, int maxdist, int maxmissed)
+{
+	TRACKVC* tracker;
+
+	if ((maxtracks <= 0) || (tolerancia < 0) || (maxdist < 0) || (maxmissed < 0))
 		return NULL;
-	if (channels != 1)
+
+	tracker = (TRACKVC*)malloc(sizeof(TRACKVC));
+	if (tracker == NULL)
+		return NULL;
+
+	tracker->tracks = (TVC*)malloc(maxtracks * sizeof(TVC));
+	if (tracker->tracks == NULL)
+	{
+		free(tracker);
 		return NULL;
+	}
+
+	tracker->ntracks = 0;
+	tracker->maxtracks = maxtracks;
+	tracker->nextid = 1;
+	tracker->linha = linha;
+	tracker->tolerancia = tolerancia;
+	tracker->maxdist = maxdist;
+	tracker->maxmissed = maxmissed;
+
+	return tracker;
+}
+
+// Libertar um seguidor
+TRACKVC* vc_tracker_free(TRACKVC* tracker)
+{
+	if (tracker != NULL)
+	{
+		free(tracker->tracks);
+		free(tracker);
+		tracker = NULL;
+	}
+
+	return tracker;
+}
 
-	// Copia dados da imagem bin�ria para imagem grayscale
-	memcpy(datadst, datasrc, bytesperline * height);
+// Posição prevista de uma trajectória nframes depois da última observação
+static void vc_track_predict(TVC* track, int nframes, OVC* previsto)
+{
+	int dx = (int)floorf(track->vx * (track->missed + nframes) + 0.5f);
+	int dy = (int)floorf(track->vy * (track->missed + nframes) + 0.5f);
+
+	previsto->x = track->blob.x + dx;
+	previsto->y = track->blob.y + dy;
+	previsto->width = track->blob.width;
+	previsto->height = track->blob.height;
+	previsto->xc = track->blob.xc + dx;
+	previsto->yc = track->blob.yc + dy;
+	previsto->area = track->blob.area;
+	previsto->perimeter = track->blob.perimeter;
+	previsto->label = track->id;
+}
+
+// Candidato (trajectória, blob) a associar
+typedef struct {
+	long long dist2;		// Quadrado da distância entre o centro previsto e o do blob
+	int track, blob;
+} VCTRACKPAR;
+
+static int vc_track_par_cmp(const void* a, const void* b)
+{
+	const VCTRACKPAR* pa = (const VCTRACKPAR*)a;
+	const VCTRACKPAR* pb = (const VCTRACKPAR*)b;
+
+	if (pa->dist2 != pb->dist2)
+		return (pa->dist2 < pb->dist2) ? -1 : 1;
+	if (pa->track != pb->track)
+		return pa->track - pb->track;
+	return pa->blob - pb->blob;
+}
+
+// Lado da linha de contagem em que está y (-1 acima, 1 abaixo, 0 na linha)
+static int vc_track_lado(TRACKVC* tracker, int y)
+{
+	return (y < tracker->linha) ? -1 : ((y > tracker->linha) ? 1 : 0);
+}
+
+// Gera o evento da trajectória se o blob j estiver na linha de contagem (ou a tiver saltado) e for aceite
+static int vc_track_evento(TRACKVC* tracker, TVC* track, int j, int saltou, int* qualifica, int* eventos, int neventos)
+{
+	if (track->crossed || ((qualifica != NULL) && !qualifica[j]))
+		return neventos;
+	if ((abs(track->blob.yc - tracker->linha) > tracker->tolerancia) && !saltou)
+		return neventos;
+
+	track->crossed = 1;
+	if (eventos != NULL)
+		eventos[neventos] = j;
+
+	return neventos + 1;
+}
+
+// Actualiza as trajectórias com os blobs de uma nova frame
+// nframes   : frames desde a actualização anterior (1 se nenhuma frame foi saltada)
+// qualifica : se não for NULL, só os blobs com qualifica[j] != 0 geram eventos (os outros deixam o
+//             evento da trajectória pendente)
+// ids       : se não for NULL, recebe o identificador da trajectória de cada blob (0 se não há espaço)
+// eventos   : se não for NULL, recebe os índices (em blobs) dos blobs cujas trajectórias passaram
+//             agora a linha de contagem; precisa de espaço para nblobs índices
+// Devolve o número de eventos, ou -1 em caso de erro.
+int vc_tracker_update(TRACKVC* tracker, OVC* blobs, int nblobs, int nframes, int* qualifica, int* ids, int* eventos)
+{
+	VCTRACKPAR* pares = NULL;
+	int* blobtrack = NULL;
+	int* trackblob = NULL;
+	int npares = 0;
+	int neventos = 0;
+	int i, j, k, lado;
+	long long dx, dy, maxdist2;
+	OVC previsto;
+	TVC* track;
 
-	// Todos os pix�is de plano de fundo devem obrigat�riamente ter valor 0
-	// Todos os pix�is de primeiro plano devem obrigat�riamente ter valor 255
-	// Ser�o atribu�das etiquetas no intervalo [1,254]
-	// Este algoritmo est� assim limitado a 254 labels
-	for (i = 0, size = bytesperline * height; i < size; i++)
-	{
-		if (datadst[i] != 0)
-			datadst[i] = 255;
-	}
+	// Verificação de erros
+	if ((tracker == NULL) || (nblobs < 0) || ((nblobs > 0) && (blobs == NULL)) || (nframes <= 0))
+		return -1;
 
-	// Limpa os rebordos da imagem bin�ria
-	for (y = 0; y < height; y++)
+	if (nblobs > 0)
 	{
-		datadst[y * bytesperline + 0 * channels] = 0;
-		datadst[y * bytesperline + (width - 1) * channels] = 0;
+		blobtrack = (int*)vc_scratch_borrow(nblobs * sizeof(int));
+		if (blobtrack == NULL)
+			return -1;
+		for (j = 0; j < nblobs; j++)
+			blobtrack[j] = -1;
 	}
-	for (x = 0; x < width; x++)
+	if (tracker->ntracks > 0)
 	{
-		datadst[0 * bytesperline + x * channels] = 0;
-		datadst[(height - 1) * bytesperline + x * channels] = 0;
+		trackblob = (int*)vc_scratch_borrow(tracker->ntracks * sizeof(int));
+		if (trackblob == NULL)
+		{
+			vc_scratch_release(blobtrack);
+			return -1;
+		}
+		for (i = 0; i < tracker->ntracks; i++)
+			trackblob[i] = -1;
 	}
 
-	// Efectua a etiquetagem
-	for (y = 1; y < height - 1; y++)
+	// Candidatos: caixa prevista a tocar a do blob, ou centro previsto perto do centro do blob
+	if ((nblobs > 0) && (tracker->ntracks > 0))
 	{
-		for (x = 1; x < width - 1; x++)
+		pares = (VCTRACKPAR*)vc_scratch_borrow((size_t)tracker->ntracks * nblobs * sizeof(VCTRACKPAR));
+		if (pares == NULL)
 		{
-			// Kernel:
-			// A B C
-			// D X
+			vc_scratch_release(trackblob);
+			vc_scratch_release(blobtrack);
+			return -1;
+		}
 
-			posA = (y - 1) * bytesperline + (x - 1) * channels; // A
-			posB = (y - 1) * bytesperline + x * channels;		// B
-			posC = (y - 1) * bytesperline + (x + 1) * channels; // C
-			posD = y * bytesperline + (x - 1) * channels;		// D
-			posX = y * bytesperline + x * channels;				// X
+		maxdist2 = (long long)tracker->maxdist * tracker->maxdist;
+		for (i = 0; i < tracker->ntracks; i++)
+		{
+			vc_track_predict(&tracker->tracks[i], nframes, &previsto);
 
-			// Se o pixel foi marcado
-			if (datadst[posX] != 0)
+			for (j = 0; j < nblobs; j++)
 			{
-				if ((datadst[posA] == 0) && (datadst[posB] == 0) && (datadst[posC] == 0) && (datadst[posD] == 0))
-				{
-					datadst[posX] = label;
-					labeltable[label] = label;
-					label++;
-				}
-				else
+				dx = blobs[j].xc - previsto.xc;
+				dy = blobs[j].yc - previsto.yc;
+
+				if ((dx * dx + dy * dy <= maxdist2) ||
+					((blobs[j].x < previsto.x + previsto.width) && (previsto.x < blobs[j].x + blobs[j].width) &&
+					(blobs[j].y < previsto.y + previsto.height) && (previsto.y < blobs[j].y + blobs[j].height)))
 				{
-					num = 255;
-
-					// Se A est� marcado
-					if (datadst[posA] != 0)
-						num = labeltable[datadst[posA]];
-					// Se B est� marcado, e � menor que a etiqueta "num"
-					if ((datadst[posB] != 0) && (labeltable[datadst[posB]] < num))
-						num = labeltable[datadst[posB]];
-					// Se C est� marcado, e � menor que a etiqueta "num"
-					if ((datadst[posC] != 0) && (labeltable[datadst[posC]] < num))
-						num = labeltable[datadst[posC]];
-					// Se D est� marcado, e � menor que a etiqueta "num"
-					if ((datadst[posD] != 0) && (labeltable[datadst[posD]] < num))
-						num = labeltable[datadst[posD]];
-
-					// Atribui a etiqueta ao pixel
-					datadst[posX] = num;
-					labeltable[num] = num;
-
-					// Actualiza a tabela de etiquetas
-					if (datadst[posA] != 0)
-					{
-						if (labeltable[datadst[posA]] != num)
-						{
-							for (tmplabel = labeltable[datadst[posA]], a = 1; a < label; a++)
-							{
-								if (labeltable[a] == tmplabel)
-								{
-									labeltable[a] = num;
-								}
-							}
-						}
-					}
-					if (datadst[posB] != 0)
-					{
-						if (labeltable[datadst[posB]] != num)
-						{
-							for (tmplabel = labeltable[datadst[posB]], a = 1; a < label; a++)
-							{
-								if (labeltable[a] == tmplabel)
-								{
-									labeltable[a] = num;
-								}
-							}
-						}
-					}
-					if (datadst[posC] != 0)
-					{
-						if (labeltable[datadst[posC]] != num)
-						{
-							for (tmplabel = labeltable[datadst[posC]], a = 1; a < label; a++)
-							{
-								if (labeltable[a] == tmplabel)
-								{
-									labeltable[a] = num;
-								}
-							}
-						}
-					}
-					if (datadst[posD] != 0)
-					{
-						if (labeltable[datadst[posD]] != num)
-						{
-							for (tmplabel = labeltable[datadst[posD]], a = 1; a < label; a++)
-							{
-								if (labeltable[a] == tmplabel)
-								{
-									labeltable[a] = num;
-								}
-							}
-						}
-					}
+					pares[npares].dist2 = dx * dx + dy * dy;
+					pares[npares].track = i;
+					pares[npares].blob = j;
+					npares++;
 				}
 			}
 		}
-	}
 
-	// Volta a etiquetar a imagem
-	for (y = 1; y < height - 1; y++)
-	{
-		for (x = 1; x < width - 1; x++)
+		// Associação gulosa, do par mais próximo para o mais afastado
+		qsort(pares, npares, sizeof(VCTRACKPAR), vc_track_par_cmp);
+		for (k = 0; k < npares; k++)
 		{
-			posX = y * bytesperline + x * channels; // X
-
-			if (datadst[posX] != 0)
+			if ((trackblob[pares[k].track] < 0) && (blobtrack[pares[k].blob] < 0))
 			{
-				datadst[posX] = labeltable[datadst[posX]];
+				trackblob[pares[k].track] = pares[k].blob;
+				blobtrack[pares[k].blob] = pares[k].track;
 			}
 		}
 	}
 
-	// printf("\nMax Label = %d\n", label);
-
-	// Contagem do n�mero de blobs
-	// Passo 1: Eliminar, da tabela, etiquetas repetidas
-	for (a = 1; a < label - 1; a++)
+	// Trajectórias associadas: velocidade (média com a anterior), posição e passagem pela linha
+	for (i = 0; i < tracker->ntracks; i++)
 	{
-		for (b = a + 1; b < label; b++)
+		track = &tracker->tracks[i];
+		j = (trackblob != NULL) ? trackblob[i] : -1;
+		track->indice = j;
+		if (j < 0)
+		{
+			track->missed += nframes;
+			continue;
+		}
+
+		k = track->missed + nframes;
+		if (track->age == 1)
+		{
+			track->vx = (float)(blobs[j].xc - track->blob.xc) / k;
+			track->vy = (float)(blobs[j].yc - track->blob.yc) / k;
+		}
+		else
 		{
-			if (labeltable[a] == labeltable[b])
-				labeltable[b] = 0;
+			track->vx = 0.5f * (track->vx + (float)(blobs[j].xc - track->blob.xc) / k);
+			track->vy = 0.5f * (track->vy + (float)(blobs[j].yc - track->blob.yc) / k);
 		}
+
+		lado = vc_track_lado(tracker, track->blob.yc) * vc_track_lado(tracker, blobs[j].yc);
+		track->blob = blobs[j];
+		track->age++;
+		track->missed = 0;
+
+		neventos = vc_track_evento(tracker, track, j, lado < 0, qualifica, eventos, neventos);
 	}
-	// Passo 2: Conta etiquetas e organiza a tabela de etiquetas, para que n�o hajam valores vazios (zero) entre etiquetas
-	*nlabels = 0;
-	for (a = 1; a < label; a++)
+
+	// Apaga as trajectórias perdidas há demasiadas frames (mantendo a ordem das restantes)
+	for (i = 0, k = 0; i < tracker->ntracks; i++)
+	{
+		if (tracker->tracks[i].missed <= tracker->maxmissed)
+			tracker->tracks[k++] = tracker->tracks[i];
+	}
+	tracker->ntracks = k;
+
+	// Blobs sem trajectória: trajectórias novas (se houver espaço)
+	for (j = 0; (j < nblobs) && (tracker->ntracks < tracker->maxtracks); j++)
+	{
+		if (blobtrack[j] >= 0)
+			continue;
+
+		track = &tracker->tracks[tracker->ntracks++];
+		track->id = tracker->nextid++;
+		track->blob = blobs[j];
+		track->vx = 0.0f;
+		track->vy = 0.0f;
+		track->age = 1;
+		track->missed = 0;
+		track->indice = j;
+		track->crossed = 0;
+
+		neventos = vc_track_evento(tracker, track, j, 0, qualifica, eventos, neventos);
+	}
+
+	if (ids != NULL)
 	{
-		if (labeltable[a] != 0)
+		for (j = 0; j < nblobs; j++)
+			ids[j] = 0;
+		for (i = 0; i < tracker->ntracks; i++)
 		{
-			labeltable[*nlabels] = labeltable[a]; // Organiza tabela de etiquetas
-			(*nlabels)++;						  // Conta etiquetas
+			if (tracker->tracks[i].indice >= 0)
+				ids[tracker->tracks[i].indice] = tracker->tracks[i].id;
 		}
 	}
 
-	// Se n�o h� blobs
-	if (*nlabels == 0)
-		return NULL;
+	vc_scratch_release(pares);
+	vc_scratch_release(trackblob);
+	vc_scratch_release(blobtrack);
 
-	// Cria lista de blobs (objectos) e preenche a etiqueta
-	blobs = (OVC*)calloc((*nlabels), sizeof(OVC));
-	if (blobs != NULL)
+	return neventos;
+}
+
+// Janelas de procura: posição prevista de cada trajectória nframes depois da última actualização,
+// com margem pixéis a mais de cada lado (label = identificador da trajectória)
+// Permite limitar a etiquetagem e a análise das cores às zonas onde se esperam os blobs; o programa
+// (VC-23-24.cpp) não a usa, porque a etiquetagem por corridas da faixa inteira já é barata.
+// Devolve o número de janelas escritas em janelas (no máximo maxjanelas).
+int vc_tracker_predict(TRACKVC* tracker, int nframes, int margem, OVC* janelas, int maxjanelas)
+{
+	int i, n;
+
+	// Verificação de erros
+	if ((tracker == NULL) || (janelas == NULL) || (nframes < 0) || (margem < 0))
+		return 0;
+
+	for (i = 0, n = 0; (i < tracker->ntracks) && (n < maxjanelas); i++, n++)
 	{
-		for (a = 0; a < (*nlabels); a++)
-			blobs[a].label = labeltable[a];
+		vc_track_predict(&tracker->tracks[i], nframes, &janelas[n]);
+		janelas[n].x -= margem;
+		janelas[n].y -= margem;
+		janelas[n].width += 2 * margem;
+		janelas[n].height += 2 * margem;
 	}
-	else
-		return NULL;
 
-	return blobs;
+	return n;
 }
 
-int vc_binary_blob_info(IVC* src, OVC* blobs, int nblobs) // os blobs acima indentificados sao um corpo
-{
-	unsigned char* data = (unsigned char*)src->data;
-	int width = src->width;
-	int height = src->height;
-	int bytesperline = src->bytesperline;
-	int channels = src->channels;
-	int x, y, i;
-	long int pos;
-	int xmin, ymin, xmax, ymax;
-	long int sumx, sumy;
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//          DETECÇÃO DE MOVIMENTO (DIFERENÇA ENTRE FRAMES)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 
-	// Verificacao de erros
-	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL))
+// Compara uma frame com uma referência guardada só nos pixéis (x, y) com x e y múltiplos de step.
+// A referência é uma imagem com (width + step - 1) / step x (height + step - 1) / step pixéis e os
+// mesmos canais que a frame, preenchida por vc_motion_update. Com step = 4 só 1/16 dos pixéis é lido.
+
+// Verifica se ref tem o tamanho das amostras de src com passo step
+static int vc_motion_check(IVC* src, IVC* ref, int step)
+{
+	if ((src == NULL) || (ref == NULL) || (src->data == NULL) || (ref->data == NULL) || (step <= 0))
 		return 0;
-	if (channels != 1)
+	if ((src->width <= 0) || (src->height <= 0) || (src->channels != ref->channels))
 		return 0;
 
-	// Conta area de cada blob
-	for (i = 0; i < nblobs; i++)
-	{
-		xmin = width - 1;
-		ymin = height - 1;
-		xmax = 0;
-		ymax = 0;
+	return (ref->width == (src->width + step - 1) / step) && (ref->height == (src->height + step - 1) / step);
+}
 
-		sumx = 0;
-		sumy = 0;
+// Número de amostras de src em que algum canal difere da referência mais do que threshold
+// Devolve -1 se as imagens não forem compatíveis.
+int vc_motion_score(IVC* src, IVC* ref, int step, int threshold)
+{
+	int channels = src->channels;
+	int x, y, c, diff;
+	int count = 0;
+	unsigned char* p;
+	unsigned char* q;
 
-		blobs[i].area = 0;
+	// Verificação de erros
+	if (!vc_motion_check(src, ref, step))
+		return -1;
 
-		for (y = 1; y < height - 1; y++)
+	for (y = 0; y < ref->height; y++)
+	{
+		p = src->data + (size_t)y * step * src->bytesperline;
+		q = ref->data + y * ref->bytesperline;
+
+		for (x = 0; x < ref->width; x++, p += step * channels, q += channels)
 		{
-			for (x = 1; x < width - 1; x++)
+			for (c = 0; c < channels; c++)
 			{
-				pos = y * bytesperline + x * channels;
-
-				if (data[pos] == blobs[i].label)
+				diff = p[c] - q[c];
+				if ((diff > threshold) || (diff < -threshold))
 				{
-					// area
-					blobs[i].area++;
-
-					// Centro de Gravidade
-					sumx += x;
-					sumy += y;
-
-					// Bounding Box
-					if (xmin > x)
-						xmin = x;
-					if (ymin > y)
-						ymin = y;
-					if (xmax < x)
-						xmax = x;
-					if (ymax < y)
-						ymax = y;
-
-					// Per�metro
-					// Se pelo menos um dos quatro vizinhos n�o pertence ao mesmo label, ent�o � um pixel de contorno
-					if ((data[pos - 1] != blobs[i].label) || (data[pos + 1] != blobs[i].label) || (data[pos - bytesperline] != blobs[i].label) || (data[pos + bytesperline] != blobs[i].label))
-					{
-						blobs[i].perimeter++;
-					}
+					count++;
+					break;
 				}
 			}
 		}
+	}
+
+	return count;
+}
+
+// Número de amostras de src (passo step nas duas direcções) que vc_rgb_to_hsv_segmentation poria na máscara
+// com os mesmos intervalos (conversão de vc_hsv_pixel, idêntica à da imagem inteira). src é BGR.
+// Devolve -1 em caso de erro.
+int vc_motion_hsv_count(IVC* src, int step, int hmin, int hmax, int smin, int smax, int vmin, int vmax)
+{
+	unsigned char lut[3][256];
+	unsigned char hsv[3];
+	unsigned char* p;
+	int x, y;
+	int count = 0;
+
+	// Verificação de erros
+	if ((src == NULL) || (src->data == NULL) || (src->width <= 0) || (src->height <= 0) || (step <= 0))
+		return -1;
+	if (src->channels != 3)
+		return -1;
+
+	vc_hsv_range_lut(lut, hmin, hmax, smin, smax, vmin, vmax);
+
+	for (y = 0; y < src->height; y += step)
+	{
+		p = src->data + (size_t)y * src->bytesperline;
+
+		for (x = 0; x < src->width; x += step, p += step * 3)
+		{
+			vc_hsv_pixel(p, hsv);
+			if (lut[0][hsv[0]] & lut[1][hsv[1]] & lut[2][hsv[2]])
+				count++;
+		}
+	}
+
+	return count;
+}
 
-		// Bounding Box
-		blobs[i].x = xmin;
-		blobs[i].y = ymin;
-		blobs[i].width = (xmax - xmin) + 1;
-		blobs[i].height = (ymax - ymin) + 1;
+// Guarda em ref as amostras de src (passo step nas duas direcções)
+int vc_motion_update(IVC* src, IVC* ref, int step)
+{
+	int channels = src->channels;
+	int x, y, c;
+	unsigned char* p;
+	unsigned char* q;
+
+	// Verificação de erros
+	if (!vc_motion_check(src, ref, step))
+		return 0;
+
+	for (y = 0; y < ref->height; y++)
+	{
+		p = src->data + (size_t)y * step * src->bytesperline;
+		q = ref->data + y * ref->bytesperline;
 
-		// Centro de Gravidade
-		// blobs[i].xc = (xmax - xmin) / 2;
-		// blobs[i].yc = (ymax - ymin) / 2;
-		blobs[i].xc = sumx / MAX(blobs[i].area, 1);
-		blobs[i].yc = sumy / MAX(blobs[i].area, 1);
+		for (x = 0; x < ref->width; x++, p += step * channels, q += channels)
+		{
+			for (c = 0; c < channels; c++)
+				q[c] = p[c];
+		}
 	}
 
 	return 1;
@@ -1602,7 +4342,7 @@ int vc_draw_center_of_mass(IVC* src, OVC* blobs, int nblobs, int tamanho_alvo, i
 	int width = src->width;
 	int height = src->height;
 	int channels = src->channels;
-	int bytesperline = width * channels;
+	int bytesperline = src->bytesperline;
 	int x, y;
 	long int pos;
 	int i;
@@ -1620,8 +4360,8 @@ int vc_draw_center_of_mass(IVC* src, OVC* blobs, int nblobs, int tamanho_alvo, i
 		{
 			for (x = -tamanho_alvo; x <= tamanho_alvo; x++)
 			{
-				// desenha a cruz
-				if (y == 0 || x == 0)
+				// desenha a cruz (só a parte dentro da imagem)
+				if ((y == 0 || x == 0) && (y + blobs[i].yc >= 0) && (y + blobs[i].yc < height) && (x + blobs[i].xc >= 0) && (x + blobs[i].xc < width))
 				{
 					pos = (y + blobs[i].yc) * bytesperline + (x + blobs[i].xc) * channels;
 
@@ -1674,11 +4414,13 @@ int vc_normalizar_imagem_labelling(IVC* src, IVC* dst, int nblobs)
 			{ // i = labels
 				if (data_src[pos] == i)
 				{
-					data_dst[pos] = (i * 255) / nblobs; // Pinta os objetos de acordo com o numero de blobs --- Ex: layer 2 * 255 / 3 = 170
+					data_dst[y * dst->bytesperline + x] = (i * 255) / nblobs; // Pinta os objetos de acordo com o numero de blobs --- Ex: layer 2 * 255 / 3 = 170
 				}
 			}
 		}
 	}
+
+	return 1;
 }
 
 int vc_gray_histogram_show(IVC* src, IVC* dst)
@@ -1700,9 +4442,12 @@ int vc_gray_histogram_show(IVC* src, IVC* dst)
 	}
 
 	// Cálculo do histograma
-	for (y = 0; y < height * width; y++)
+	for (y = 0; y < height; y++)
 	{
-		histogram[data_src[y]]++;
+		for (x = 0; x < width; x++)
+		{
+			histogram[data_src[y * src->bytesperline + x]]++;
+		}
 	}
 
 	// Buscar Máximo do Histograma
@@ -1727,11 +4472,11 @@ int vc_gray_histogram_show(IVC* src, IVC* dst)
 		{
 			if (height - y <= histogram[x])
 			{
-				data_dst[y * dst->width + x] = 255; // Branco
+				data_dst[y * dst->bytesperline + x] = 255; // Branco
 			}
 			else
 			{
-				data_dst[y * dst->width + x] = 0; // Preto
+				data_dst[y * dst->bytesperline + x] = 0; // Preto
 			}
 		}
 	}
@@ -1760,9 +4505,12 @@ int vc_gray_histogram_equalization(IVC* src, IVC* dst)
 	}
 
 	// Calcular o histograma
-	for (y = 0; y < height * width; y++)
+	for (y = 0; y < height; y++)
 	{
-		histogram[data_src[y]]++;
+		for (x = 0; x < width; x++)
+		{
+			histogram[data_src[y * src->bytesperline + x]]++;
+		}
 	}
 
 	// Calcular o cdf
@@ -1792,40 +4540,30 @@ int vc_gray_histogram_equalization(IVC* src, IVC* dst)
 	{
 		for (x = 0; x < width; x++)
 		{
-			int index = y * width + x;
-			data_dst[index] = (unsigned char)(g[data_src[index]] * max_intensity);
+			data_dst[y * dst->bytesperline + x] = (unsigned char)(g[data_src[y * src->bytesperline + x]] * max_intensity);
 		}
 	}
 
 	return 1;
 }
 
-#define CLAMP(x, min, max) (((x) < (min)) ? (min) : (((x) > (max)) ? (max) : (x)))
-
-int vc_gray_edge_prewitt(IVC* src, IVC* dst, float th)
+// Linhas [y0, y1[ do operador de Prewitt (job->fparam = limiar)
+static void vc_prewitt_band(VCBANDJOB* job, int band, int y0, int y1)
 {
-	unsigned char* datasrc = (unsigned char*)src->data;
-	unsigned char* datadst = (unsigned char*)dst->data;
-	int width = src->width;
-	int height = src->height;
-	int bytesperline = src->bytesperline;
-	int channels = src->channels;
-	long int pos, posk;
+	unsigned char* datasrc = (unsigned char*)job->src->data;
+	unsigned char* datadst = (unsigned char*)job->dst->data;
+	int width = job->src->width;
+	int height = job->src->height;
+	int bytesperline = job->src->bytesperline;
+	float th = job->fparam;
+	long int posk;
 	int x, y, kx, ky;
-	int offset = 1;
 	int pixelx, pixely;
 	float grad_x, grad_y;
 	float magnitude;
-	int i, j;
-
-	// Verificação de erros
-	if (width <= 0 || height <= 0 || datasrc == NULL || datadst == NULL)
-		return 0;
-	if (channels != 1) // Verificar se a imagem tem apenas 1 canal (gray)
-		return 0;
 
 	// Aplicar o operador em x (derivada)
-	for (y = 0; y < height; y++)
+	for (y = y0; y < y1; y++)
 	{
 		for (x = 0; x < width; x++)
 		{
@@ -1848,158 +4586,349 @@ int vc_gray_edge_prewitt(IVC* src, IVC* dst, float th)
 			// Calcular a magnitude do vetor
 			magnitude = sqrt(grad_x * grad_x + grad_y * grad_y);
 			// Aplicar threshold
-			datadst[y * bytesperline + x] = (magnitude > th) ? 255 : 0;
+			datadst[y * job->dst->bytesperline + x] = (magnitude > th) ? 255 : 0;
 		}
 	}
+}
+
+int vc_gray_edge_prewitt(IVC* src, IVC* dst, float th)
+{
+	unsigned char* datasrc = (unsigned char*)src->data;
+	unsigned char* datadst = (unsigned char*)dst->data;
+	int width = src->width;
+	int height = src->height;
+	int channels = src->channels;
+	VCBANDJOB job = { src, dst, 3, 0, th, NULL, NULL };
+
+	// Verificação de erros
+	if (width <= 0 || height <= 0 || datasrc == NULL || datadst == NULL)
+		return 0;
+	if (channels != 1) // Verificar se a imagem tem apenas 1 canal (gray)
+		return 0;
+
+	vc_parallel_for(vc_prewitt_band, &job, height, vc_parallel_nbands(height, VC_BAND_MIN));
 
 	return 1;
 }
 
 
+// Linhas [ystart, yend[ do filtro da média (job->aux = imagem integral)
+static void vc_mean_band(VCBANDJOB* job, int band, int ystart, int yend) {
+
+	unsigned char* datadst = (unsigned char*)job->dst->data;
+	int bytesperline_dst = job->dst->bytesperline;
+	int width = job->src->width;
+	int height = job->src->height;
+	int stride = width + 1;
+	int offset = MAX((job->kernel - 1) / 2, 0);
+	unsigned int* soma = (unsigned int*)job->aux;
+	int x, y, x0, x1, y0, y1;
+
+	// Percorrer a Imagem
+	for (y = ystart; y < yend; y++) {
+		y0 = MAX(y - offset, 0);
+		y1 = MIN(y + offset, height - 1) + 1;
+
+		for (x = 0; x < width; x++) {
+			x0 = MAX(x - offset, 0);
+			x1 = MIN(x + offset, width - 1) + 1;
+
+			// Media = somatorio das posições / numero de pixeis da janela dentro da imagem
+			datadst[y * bytesperline_dst + x] = vc_integral_window(soma, stride, x0, y0, x1, y1) / ((x1 - x0) * (y1 - y0));
+		}
+	}
+}
+
 int vc_gray_lowpass_mean_filter(IVC* src, IVC* dst, int kernel) {
 
-	unsigned char* datasrc = (unsigned char*)src->data;
-	int bytesperline_src = src->width * src->channels;
-	int channels_src = src->channels;
-	unsigned char* datadst = (unsigned char*)dst->data;
-	int bytesperline_dst = dst->width * dst->channels;
-	int channels_dst = dst->channels;
 	int width = src->width;
 	int height = src->height;
-	int x, y, yy, xx;
-	long int pos_src, pos_dst;
-	int media, soma;
+	int stride = width + 1;
+	unsigned int* soma;
+	VCBANDJOB job = { src, dst, kernel, 0, 0.0f, NULL, NULL };
 
 	// Validações
 	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL)) return 0;
-	if ((src->width != dst->width) || (src->height != dst->height)) return 0;
+	if ((src->width != dst->width) || (src->height != dst->height) || (dst->data == NULL)) return 0;
 	if ((src->channels != 1) || (dst->channels != 1))return 0;
 
+	// Imagem integral: a soma de qualquer janela custa 4 acessos
+	soma = (unsigned int*)vc_scratch_borrow(stride * (height + 1) * sizeof(unsigned int));
+	if (soma == NULL) return 0;
 
-	// Percorrer a Imagem
-	for (y = 0; y < height; y++) {
-		for (x = 0; x < width; x++) {
+	vc_gray_integral(src, soma, NULL);
 
-			pos_dst = y * bytesperline_dst + x * channels_dst; // Posição dst
-			media = 0; // Resetar a média a cada loop
-			soma = 0; // Resetar a soma a cada loop
+	job.aux = soma;
+	vc_parallel_for(vc_mean_band, &job, height, vc_parallel_nbands(height, VC_BAND_MIN));
 
-			for (yy = y - ((kernel - 1) / 2); yy <= (y + ((kernel - 1) / 2)); yy++) {
-				for (xx = x - ((kernel - 1) / 2); xx <= (x + ((kernel - 1) / 2)); xx++) {
+	vc_scratch_release(soma);
 
-					if ((xx >= 0) && (xx < width) && (yy >= 0) && (yy < height)) {
+	return 1;
+}
 
-						pos_src = yy * bytesperline_src + xx * channels_src;
-						soma += datasrc[pos_src];
+// As redes de ordenação processam VC_MEDIAN_LANES pixéis consecutivos de cada vez:
+// p[i][l] é o i-ésimo vizinho do l-ésimo pixel, e cada comparação é um MIN/MAX sobre
+// vectores de pixéis, que o compilador vectoriza.
+#define VC_MEDIAN_LANES 32
 
-					}
+// Ordena p[i] e p[j] de forma a que p[i] <= p[j], sem saltos (elemento de uma rede de ordenação)
+static void vc_pix_sort(unsigned char* a, unsigned char* b)
+{
+	unsigned char t;
+	int l;
 
-				}
-			}
+	for (l = 0; l < VC_MEDIAN_LANES; l++)
+	{
+		t = MIN(a[l], b[l]);
+		b[l] = MAX(a[l], b[l]);
+		a[l] = t;
+	}
+}
+
+#define VC_PIX_SORT(i, j) vc_pix_sort(p[i], p[j])
+
+// Mediana de 9 valores em p[4] (rede de ordenação com 19 comparações)
+static void vc_median_network9(unsigned char p[][VC_MEDIAN_LANES])
+{
+	VC_PIX_SORT(1, 2);   VC_PIX_SORT(4, 5);   VC_PIX_SORT(7, 8);
+	VC_PIX_SORT(0, 1);   VC_PIX_SORT(3, 4);   VC_PIX_SORT(6, 7);
+	VC_PIX_SORT(1, 2);   VC_PIX_SORT(4, 5);   VC_PIX_SORT(7, 8);
+	VC_PIX_SORT(0, 3);   VC_PIX_SORT(5, 8);   VC_PIX_SORT(4, 7);
+	VC_PIX_SORT(3, 6);   VC_PIX_SORT(1, 4);   VC_PIX_SORT(2, 5);
+	VC_PIX_SORT(4, 7);   VC_PIX_SORT(4, 2);   VC_PIX_SORT(6, 4);
+	VC_PIX_SORT(4, 2);
+}
 
-			// Media = ao somatorio das posições / pelo Kernel*kernel (3x3, 5x5, 9x9)
-			media = soma / (kernel * kernel);
-			datadst[pos_dst] = media;
+// Mediana de 25 valores em p[12] (rede de ordenação com 99 comparações)
+static void vc_median_network25(unsigned char p[][VC_MEDIAN_LANES])
+{
+	VC_PIX_SORT(0, 1);   VC_PIX_SORT(3, 4);   VC_PIX_SORT(2, 4);
+	VC_PIX_SORT(2, 3);   VC_PIX_SORT(6, 7);   VC_PIX_SORT(5, 7);
+	VC_PIX_SORT(5, 6);   VC_PIX_SORT(9, 10);  VC_PIX_SORT(8, 10);
+	VC_PIX_SORT(8, 9);   VC_PIX_SORT(12, 13); VC_PIX_SORT(11, 13);
+	VC_PIX_SORT(11, 12); VC_PIX_SORT(15, 16); VC_PIX_SORT(14, 16);
+	VC_PIX_SORT(14, 15); VC_PIX_SORT(18, 19); VC_PIX_SORT(17, 19);
+	VC_PIX_SORT(17, 18); VC_PIX_SORT(21, 22); VC_PIX_SORT(20, 22);
+	VC_PIX_SORT(20, 21); VC_PIX_SORT(23, 24); VC_PIX_SORT(2, 5);
+	VC_PIX_SORT(3, 6);   VC_PIX_SORT(0, 6);   VC_PIX_SORT(0, 3);
+	VC_PIX_SORT(4, 7);   VC_PIX_SORT(1, 7);   VC_PIX_SORT(1, 4);
+	VC_PIX_SORT(11, 14); VC_PIX_SORT(8, 14);  VC_PIX_SORT(8, 11);
+	VC_PIX_SORT(12, 15); VC_PIX_SORT(9, 15);  VC_PIX_SORT(9, 12);
+	VC_PIX_SORT(13, 16); VC_PIX_SORT(10, 16); VC_PIX_SORT(10, 13);
+	VC_PIX_SORT(20, 23); VC_PIX_SORT(17, 23); VC_PIX_SORT(17, 20);
+	VC_PIX_SORT(21, 24); VC_PIX_SORT(18, 24); VC_PIX_SORT(18, 21);
+	VC_PIX_SORT(19, 22); VC_PIX_SORT(8, 17);  VC_PIX_SORT(9, 18);
+	VC_PIX_SORT(0, 18);  VC_PIX_SORT(0, 9);   VC_PIX_SORT(10, 19);
+	VC_PIX_SORT(1, 19);  VC_PIX_SORT(1, 10);  VC_PIX_SORT(11, 20);
+	VC_PIX_SORT(2, 20);  VC_PIX_SORT(2, 11);  VC_PIX_SORT(12, 21);
+	VC_PIX_SORT(3, 21);  VC_PIX_SORT(3, 12);  VC_PIX_SORT(13, 22);
+	VC_PIX_SORT(4, 22);  VC_PIX_SORT(4, 13);  VC_PIX_SORT(14, 23);
+	VC_PIX_SORT(5, 23);  VC_PIX_SORT(5, 14);  VC_PIX_SORT(15, 24);
+	VC_PIX_SORT(6, 24);  VC_PIX_SORT(6, 15);  VC_PIX_SORT(7, 16);
+	VC_PIX_SORT(7, 19);  VC_PIX_SORT(13, 21); VC_PIX_SORT(15, 23);
+	VC_PIX_SORT(7, 13);  VC_PIX_SORT(7, 15);  VC_PIX_SORT(1, 9);
+	VC_PIX_SORT(3, 11);  VC_PIX_SORT(5, 17);  VC_PIX_SORT(11, 17);
+	VC_PIX_SORT(9, 17);  VC_PIX_SORT(4, 10);  VC_PIX_SORT(6, 12);
+	VC_PIX_SORT(7, 14);  VC_PIX_SORT(4, 6);   VC_PIX_SORT(4, 7);
+	VC_PIX_SORT(12, 14); VC_PIX_SORT(10, 14); VC_PIX_SORT(6, 7);
+	VC_PIX_SORT(10, 12); VC_PIX_SORT(6, 10);  VC_PIX_SORT(6, 17);
+	VC_PIX_SORT(12, 17); VC_PIX_SORT(7, 17);  VC_PIX_SORT(7, 10);
+	VC_PIX_SORT(12, 18); VC_PIX_SORT(7, 12);  VC_PIX_SORT(10, 18);
+	VC_PIX_SORT(12, 20); VC_PIX_SORT(10, 20); VC_PIX_SORT(10, 12);
+}
+
+// Mediana da janela (2 * offset + 1)^2 centrada em (x, y), limitada à imagem
+// Usada nos rebordos quando a janela não cabe na rede de ordenação
+static unsigned char vc_median_window(unsigned char* datasrc, int bytesperline, int width, int height, int x, int y, int offset, unsigned char* lista)
+{
+	int xx, yy, i, count = 0;
+	unsigned char v;
+
+	for (yy = MAX(y - offset, 0); yy <= MIN(y + offset, height - 1); yy++)
+	{
+		for (xx = MAX(x - offset, 0); xx <= MIN(x + offset, width - 1); xx++)
+		{
+			// Insertion sort
+			v = datasrc[yy * bytesperline + xx];
+			for (i = count; (i > 0) && (lista[i - 1] > v); i--)
+				lista[i] = lista[i - 1];
+			lista[i] = v;
+			count++;
 		}
 	}
 
-	return 1;
+	return lista[count / 2];
 }
 
-int vc_gray_lowpass_median_filter(IVC* src, IVC* dst, int kernel) {
+// Filtro da mediana 3x3 e 5x5 com redes de ordenação, nas linhas [y0, y1[
+static void vc_median_network(unsigned char* datasrc, int bytesperline_src, unsigned char* datadst, int bytesperline_dst, int width, int height, int y0, int y1, int offset)
+{
+	unsigned char p[25][VC_MEDIAN_LANES];
+	unsigned char lista[25];
+	int x, y, ky, kx, n, xstart;
+	int mediana = (offset == 1) ? 4 : 12;
 
-	unsigned char* datasrc = (unsigned char*)src->data;
-	int width = src->width;
-	int height = src->height;
-	int channels_src = src->channels;
-	unsigned char* datadst = (unsigned char*)dst->data;
-	int channels_dst = dst->channels;
-	int x, y, yy, xx;
-	long int pos_src, pos_dst;
-	int offset = kernel / 2;
-	int count;
+	for (y = y0; y < y1; y++)
+	{
+		// Rebordos e imagens mais estreitas que um bloco de pixéis
+		if ((y < offset) || (y >= height - offset) || (width - 2 * offset < VC_MEDIAN_LANES))
+		{
+			for (x = 0; x < width; x++)
+				datadst[y * bytesperline_dst + x] = vc_median_window(datasrc, bytesperline_src, width, height, x, y, offset, lista);
+			continue;
+		}
 
-	// Array para armazenar os pixels da vizinhança
-	unsigned char* lista = (unsigned char*)malloc(kernel * kernel * sizeof(unsigned char));
+		for (x = 0; x < offset; x++)
+		{
+			datadst[y * bytesperline_dst + x] = vc_median_window(datasrc, bytesperline_src, width, height, x, y, offset, lista);
+			datadst[y * bytesperline_dst + width - 1 - x] = vc_median_window(datasrc, bytesperline_src, width, height, width - 1 - x, y, offset, lista);
+		}
 
-	// Validações de entrada
-	if (width <= 0 || height <= 0 || datasrc == NULL || datadst == NULL) {
-		free(lista); // Libera a memória alocada
-		return 0;
+		// Pixéis interiores em blocos de VC_MEDIAN_LANES (o último bloco sobrepõe-se ao anterior)
+		for (xstart = offset; xstart < width - offset; xstart += VC_MEDIAN_LANES)
+		{
+			x = MIN(xstart, width - offset - VC_MEDIAN_LANES);
+
+			for (n = 0, ky = -offset; ky <= offset; ky++)
+			{
+				for (kx = -offset; kx <= offset; kx++, n++)
+					memcpy(p[n], datasrc + (y + ky) * bytesperline_src + x + kx, VC_MEDIAN_LANES);
+			}
+
+			if (offset == 1)
+				vc_median_network9(p);
+			else
+				vc_median_network25(p);
+
+			memcpy(datadst + y * bytesperline_dst + x, p[mediana], VC_MEDIAN_LANES);
+		}
 	}
-	if (width != dst->width || height != dst->height || channels_src != 1 || channels_dst != 1) {
-		free(lista); // Libera a memória alocada
-		return 0;
+}
+
+// Filtro da mediana com histograma deslizante (Huang), nas linhas [ystart, yend[
+// Em cada linha o histograma da janela é actualizado coluna a coluna (entra uma, sai outra)
+// e a mediana é seguida a partir da posição anterior, pelo que o custo é O(kernel) por pixel.
+static void vc_median_band(VCBANDJOB* job, int band, int ystart, int yend) {
+
+	unsigned char* datasrc = (unsigned char*)job->src->data;
+	int width = job->src->width;
+	int height = job->src->height;
+	int bytesperline_src = job->src->bytesperline;
+	unsigned char* datadst = (unsigned char*)job->dst->data;
+	int bytesperline_dst = job->dst->bytesperline;
+	int x, y, yy, y0, y1, xc;
+	int offset = MAX(job->kernel / 2, 0);
+	int histograma[256];
+	int mediana, abaixo, alvo, ncols, nrows;
+	unsigned char v;
+
+#ifdef VC_MEDIAN_SORTING_NETWORK
+	if (offset == 1 || offset == 2) {
+		vc_median_network(datasrc, bytesperline_src, datadst, bytesperline_dst, width, height, ystart, yend, offset);
+		return;
 	}
+#endif
+
+	// Percorrer a imagem linha a linha
+	for (y = ystart; y < yend; y++) {
+		y0 = MAX(y - offset, 0);
+		y1 = MIN(y + offset, height - 1);
+		nrows = y1 - y0 + 1;
+
+		// Histograma da janela do primeiro pixel da linha
+		memset(histograma, 0, sizeof(histograma));
+		ncols = MIN(offset, width - 1) + 1;
+		for (xc = 0; xc < ncols; xc++) {
+			for (yy = y0; yy <= y1; yy++) {
+				histograma[datasrc[yy * bytesperline_src + xc]]++;
+			}
+		}
+
+		// mediana: valor actual; abaixo: número de pixéis da janela com valor inferior à mediana
+		mediana = 0;
+		abaixo = 0;
 
-	// Percorrer a imagem pixel por pixel
-	for (y = 0; y < height; y++) {
 		for (x = 0; x < width; x++) {
-			count = 0;
-
-			// Percorrer a vizinhança do pixel central (x, y)
-			for (yy = y - offset; yy <= y + offset; yy++) {
-				for (xx = x - offset; xx <= x + offset; xx++) {
-					// Verificar se o pixel vizinho está dentro dos limites da imagem
-					if (xx >= 0 && xx < width && yy >= 0 && yy < height) {
-						// Calcular a posição do pixel vizinho na imagem de origem
-						pos_src = yy * src->bytesperline + xx * channels_src;
-						// Adicionar o valor do pixel na janela
-						lista[count++] = datasrc[pos_src];
+			if (x > 0) {
+				// Coluna que entra na janela
+				xc = x + offset;
+				if (xc < width) {
+					for (yy = y0; yy <= y1; yy++) {
+						v = datasrc[yy * bytesperline_src + xc];
+						histograma[v]++;
+						if (v < mediana) abaixo++;
 					}
+					ncols++;
 				}
-			}
 
-			// Ordenar os valores na janela para encontrar a mediana
-			for (int i = 0; i < count - 1; i++) {
-				for (int j = i + 1; j < count; j++) {
-					if (lista[i] > lista[j]) {
-						// Trocar os valores se estiverem fora de ordem
-						unsigned char temp = lista[i];
-						lista[i] = lista[j];
-						lista[j] = temp;
+				// Coluna que sai da janela
+				xc = x - offset - 1;
+				if (xc >= 0) {
+					for (yy = y0; yy <= y1; yy++) {
+						v = datasrc[yy * bytesperline_src + xc];
+						histograma[v]--;
+						if (v < mediana) abaixo--;
 					}
+					ncols--;
 				}
 			}
 
-			// Calcular a posição do pixel na imagem de destino
-			pos_dst = y * dst->bytesperline + x * channels_dst;
-			// Atribuir o valor mediano ao pixel na imagem de destino
-			datadst[pos_dst] = lista[count / 2];
+			// A mediana é o elemento de ordem count / 2 dos valores ordenados
+			alvo = (ncols * nrows) / 2;
+			while (abaixo > alvo) {
+				mediana--;
+				abaixo -= histograma[mediana];
+			}
+			while (abaixo + histograma[mediana] <= alvo) {
+				abaixo += histograma[mediana];
+				mediana++;
+			}
+
+			datadst[y * bytesperline_dst + x] = (unsigned char)mediana;
 		}
 	}
+}
+
+int vc_gray_lowpass_median_filter(IVC* src, IVC* dst, int kernel) {
+
+	VCBANDJOB job = { src, dst, kernel, 0, 0.0f, NULL, NULL };
+
+	// Validações de entrada
+	if (src->width <= 0 || src->height <= 0 || src->data == NULL || dst->data == NULL) {
+		return 0;
+	}
+	if (src->width != dst->width || src->height != dst->height || src->channels != 1 || dst->channels != 1) {
+		return 0;
+	}
+
+	vc_parallel_for(vc_median_band, &job, src->height, vc_parallel_nbands(src->height, VC_BAND_MIN));
 
-	// Libera a memória alocada para a janela
-	free(lista);
 	return 1;
 }
 
-int vc_gray_lowpass_gaussian_filter(IVC* src, IVC* dst)
+// Linhas [y0, y1[ do filtro gaussiano 3x3 (só pixéis interiores)
+static void vc_gaussian_band(VCBANDJOB* job, int band, int y0, int y1)
 {
-	unsigned char* data = (unsigned char*)src->data;
-	unsigned char* data_dst = (unsigned char*)dst->data;
-	int width = src->width;
-	int height = src->height;
-	int bytesperline = src->bytesperline;
-	int channels = src->channels;
+	unsigned char* data = (unsigned char*)job->src->data;
+	unsigned char* data_dst = (unsigned char*)job->dst->data;
+	int width = job->src->width;
+	int height = job->src->height;
+	int bytesperline = job->src->bytesperline;
+	int channels = job->src->channels;
 	long int pos, posk;
 	int x, y, kx, ky;
 	int values[9];
-	int i, j, n, tmp;
+	int i, j, n;
 	float mask[3][3] = {
 		{1.0 / 16.0, 2.0 / 16.0, 1.0 / 16.0},
 		{2.0 / 16.0, 4.0 / 16.0, 2.0 / 16.0},
 		{1.0 / 16.0, 2.0 / 16.0, 1.0 / 16.0}
 	};
 
-	// Verificação de erros
-	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL)) return 0;
-	if (channels != 1) return 0;
-
 	// Percorre todos os pixels da imagem de entrada
-	for (y = 1; y < height - 1; y++) {
+	for (y = MAX(y0, 1); y < MIN(y1, height - 1); y++) {
 		for (x = 1; x < width - 1; x++) {
-			pos = y * bytesperline + x * channels;
+			pos = y * job->dst->bytesperline + x * channels;
 
 			// NxM vizinhos
 			n = 0;
@@ -2020,7 +4949,17 @@ int vc_gray_lowpass_gaussian_filter(IVC* src, IVC* dst)
 			}
 		}
 	}
+}
+
+int vc_gray_lowpass_gaussian_filter(IVC* src, IVC* dst)
+{
+	VCBANDJOB job = { src, dst, 3, 0, 0.0f, NULL, NULL };
+
+	// Verificação de erros
+	if ((src->width <= 0) || (src->height <= 0) || (src->data == NULL)) return 0;
+	if (src->channels != 1) return 0;
+
+	vc_parallel_for(vc_gaussian_band, &job, src->height, vc_parallel_nbands(src->height, VC_BAND_MIN));
 
 	return 1;
 }
-
@@ -8,7 +8,18 @@
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 
 
+// Mensagens de erro no stdout (compilar com -DVC_NDEBUG para as desligar, p.ex. nos benchmarks)
+#ifndef VC_NDEBUG
 #define VC_DEBUG
+#endif
+
+// Filtro da mediana 3x3 e 5x5 com redes de ordenação (comentar para usar sempre o histograma)
+#define VC_MEDIAN_SORTING_NETWORK
+
+// Versões SSE4.1 das conversões de cor, escolhidas em tempo de execução (comentar para usar só o código escalar)
+#define VC_USE_SIMD
+
+#include <stddef.h>
 
 
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
@@ -21,7 +32,9 @@ typedef struct {
 	int width, height;
 	int channels;			// Bin�rio/Cinzentos=1; RGB=3
 	int levels;				// Bin�rio=1; Cinzentos [1,255]; RGB [1,255]
-	int bytesperline;		// width * channels
+	int bytesperline;		// Bytes por linha (>= width * channels; maior em vistas e linhas alinhadas)
+	int ownsdata;			// 1: data foi alocado por vc_image_new; 0: vista sobre memória de outro (vc_image_wrap); 2: vc_image_borrow
+	int guard;				// Pixéis de guarda legíveis à volta da imagem (vc_image_new_aligned); 0 nas restantes
 } IVC;
 
 
@@ -31,7 +44,17 @@ typedef struct {
 
 // FUN��ES: ALOCAR E LIBERTAR UMA IMAGEM
 IVC* vc_image_new(int width, int height, int channels, int levels);
+IVC* vc_image_new_aligned(int width, int height, int channels, int levels, int guard);
+int vc_image_fill_guard(IVC* image);
 IVC* vc_image_free(IVC* image);
+IVC* vc_image_wrap(unsigned char* data, int width, int height, int channels, int levels, int bytesperline);
+IVC* vc_image_roi(IVC* src, int x, int y, int width, int height);
+
+// FUNÇÕES: RESERVA DE BUFFERS TEMPORÁRIOS (reutilizados entre chamadas em vez de malloc/free)
+void* vc_scratch_borrow(size_t size);
+void vc_scratch_release(void* ptr);
+void vc_scratch_clear(void);
+IVC* vc_image_borrow(int width, int height, int channels, int levels);	// Devolver com vc_image_free
 
 // FUN��ES: LEITURA E ESCRITA DE IMAGENS (PBM, PGM E PPM)
 IVC* vc_read_image(char* filename);
@@ -41,18 +64,23 @@ int vc_write_image(char* filename, IVC* image);
 int vc_rgb_to_binary(IVC* srcdst);
 int vc_rgb_to_hsv(IVC* srcdst);
 int vc_hsv_segmentation(IVC* src, int hmin, int hmax, int smin, int smax, int vmin, int vmax);
+int vc_rgb_to_hsv_segmentation(IVC* src, IVC* hsv, IVC* mask, int hmin, int hmax, int smin, int smax, int vmin, int vmax);
+int vc_hsv_band_profile(IVC* src, int x, int y, int width, int nrows, int segsize, int* hues, int* saturations, int* values, int maxsegments);
 int vc_scale_gray_to_rgb(IVC* src, IVC* dst);
 int vc_rgb_to_gray(IVC* src, IVC* dst);
+int vc_bgr_to_gray(IVC* src, IVC* dst);
 int vc_gray_to_binary(IVC* srcdst, int threshold);
 int vc_gray_to_binary_media(IVC* srcdst);
 int vc_gray_to_binary_midpoint(IVC* src, IVC* dst, int kernel);
 int vc_gray_to_binary_bernsen(IVC* src, IVC* dst, int kernel, int cmin);
 int vc_gray_to_binary_niblack(IVC* src, IVC* dst, int kernel, float k);
+int vc_gray_to_binary_sauvola(IVC* src, IVC* dst, int kernel, float k);
 int vc_binary_dilate(IVC* src, IVC* dst, int kernel);
 int vc_binary_erode(IVC* src, IVC* dst, int kernel);
 int vc_binary_open(IVC* src, IVC* dst, int kernel1, int kernel2);
 int vc_binary_close(IVC* src, IVC* dst, int kernel);
 int vc_gray_dilate(IVC* src, IVC* dst, int kernel);
+int vc_gray_erode(IVC* src, IVC* dst, int kernel);
 int vc_binary_to_gray(IVC* src, IVC* dst);
 int vc_gray_histogram_show(IVC* src, IVC* dst);
 int vc_gray_histogram_equalization(IVC* src, IVC* dst);
@@ -63,6 +91,41 @@ int vc_gray_lowpass_gaussian_filter(IVC* src, IVC* dst);
 int vc_3channels_to_1(IVC* src, IVC* dst);
 int vc_3channels_to_1_binary(IVC* src, IVC* dst);
 
+// FUNÇÕES: IMAGEM INTEGRAL
+int vc_gray_integral(IVC* src, unsigned int* sum, unsigned long long* sqsum);
+
+// FUNÇÕES: REDUÇÃO DE RESOLUÇÃO (média de blocos factor x factor; factor = 1, 2, 4 ou 8)
+int vc_image_downsample(IVC* src, IVC* dst, int factor);
+
+// FUNÇÕES: EXECUÇÃO EM PARALELO (0 = uma thread por processador; 1 = sem threads)
+int vc_set_num_threads(int nthreads);
+int vc_get_num_threads(void);
+
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//          ESTRUTURA DE UMA MÁSCARA BINÁRIA (1 BIT/PIXEL)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+typedef struct {
+	unsigned long long* data;	// Pixel (x, y): bit x % 64 da palavra data[y * wordsperline + x / 64]
+	int width, height;
+	int wordsperline;			// Palavras de 64 bits por linha; os bits depois de width estão sempre a 0
+} BVC;
+
+// FUNÇÕES: MÁSCARAS BINÁRIAS (64 PIXÉIS POR PALAVRA; MORFOLOGIA IGUAL A vc_binary_dilate/erode)
+BVC* vc_mask_new(int width, int height);
+BVC* vc_mask_free(BVC* mask);
+int vc_mask_from_binary(IVC* src, BVC* dst);
+int vc_mask_to_binary(BVC* src, IVC* dst);
+int vc_mask_and(BVC* a, BVC* b, BVC* dst);
+int vc_mask_or(BVC* a, BVC* b, BVC* dst);
+int vc_mask_not(BVC* src, BVC* dst);
+long long vc_mask_count(BVC* mask);
+int vc_mask_dilate(BVC* src, BVC* dst, int kernel);
+int vc_mask_erode(BVC* src, BVC* dst, int kernel);
+int vc_mask_open(BVC* src, BVC* dst, int kernel1, int kernel2);
+int vc_mask_close(BVC* src, BVC* dst, int kernel);
+
 
 
 
@@ -83,8 +146,81 @@ typedef struct {
 //                    PROTÓTIPOS DE FUNÇÕES
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 
+// As listas de blobs devolvidas pela etiquetagem são do chamador (vc_blob_list_free ou free)
 OVC* vc_binary_blob_labelling(IVC* src, IVC* dst, int* nlabels);
+OVC* vc_binary_blob_labelling32(IVC* src, int* labels, int* nlabels);
 int vc_binary_blob_info(IVC* src, OVC* blobs, int nblobs);
+int vc_binary_blob_info32(int* labels, int width, int height, OVC* blobs, int nblobs);
 int vc_draw_boundingbox(IVC* src, OVC* blob);
 int vc_draw_center_of_mass(IVC* src, OVC* blobs, int nblobs, int tamanho_alvo, int cor);
-int vc_normalizar_imagem_labelling(IVC* src, IVC* dst, int nblobs);
\ No newline at end of file
+int vc_normalizar_imagem_labelling(IVC* src, IVC* dst, int nblobs);
+OVC* vc_blob_list_free(OVC* blobs);
+
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//        ESTRUTURA DE UMA MÁSCARA EM CORRIDAS (RUN-LENGTH)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+typedef struct {
+	int x0, x1;					// Pixéis [x0, x1[ da linha
+	int y;
+	int label;					// Etiqueta do blob (preenchida por vc_rle_blob_labelling)
+} RVC;
+
+typedef struct {
+	RVC* runs;					// Corridas por linha e, dentro da linha, da esquerda para a direita
+	int nruns, maxruns;
+	int* rowstart;				// Corridas da linha y: runs[rowstart[y]] .. runs[rowstart[y + 1] - 1]
+	int width, height;
+} RLEVC;
+
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//                    PROTÓTIPOS DE FUNÇÕES
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+RLEVC* vc_rle_new(int width, int height);
+RLEVC* vc_rle_free(RLEVC* rle);
+int vc_rle_from_binary(IVC* src, RLEVC* dst);
+int vc_rle_from_mask(BVC* src, RLEVC* dst);
+OVC* vc_rle_blob_labelling(RLEVC* rle, int* nlabels);	// Mesmos blobs que vc_binary_blob_labelling32
+int vc_rle_blob_labelling_into(RLEVC* rle, OVC* blobs, int maxblobs);	// Idem, num vector do chamador (devolve o nº de blobs)
+
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//          ESTRUTURA DO SEGUIMENTO DE BLOBS (TRACKING)
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+typedef struct {
+	int id;						// Identificador persistente (1, 2, ...)
+	OVC blob;					// Última observação (caixa, centro de massa, área, ...)
+	float vx, vy;				// Velocidade do centro de massa (pixéis por frame)
+	int age;					// Número de observações
+	int missed;					// Frames desde a última observação
+	int indice;					// Índice do blob na última actualização (-1 se não foi visto)
+	int crossed;				// 1 depois do evento de passagem pela linha de contagem (blob aceite pelo chamador)
+} TVC;
+
+typedef struct {
+	TVC* tracks;
+	int ntracks, maxtracks;
+	int nextid;
+	int linha, tolerancia;		// Linha de contagem (y) e distância a que o centro conta como passagem
+	int maxdist;				// Distância máxima entre o centro previsto e o do blob associado
+	int maxmissed;				// Frames sem observação até a trajectória ser apagada
+} TRACKVC;
+
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+//                    PROTÓTIPOS DE FUNÇÕES
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+TRACKVC* vc_tracker_new(int maxtracks, int linha, int tolerancia, int maxdist, int maxmissed);
+TRACKVC* vc_tracker_free(TRACKVC* tracker);
+int vc_tracker_update(TRACKVC* tracker, OVC* blobs, int nblobs, int nframes, int* qualifica, int* ids, int* eventos);
+int vc_tracker_predict(TRACKVC* tracker, int nframes, int margem, OVC* janelas, int maxjanelas);	// Janelas de procura (só API)
+
+// FUNÇÕES: DETECÇÃO DE MOVIMENTO (amostras com passo step; ref tem (width + step - 1) / step x (height + step - 1) / step pixéis)
+int vc_motion_score(IVC* src, IVC* ref, int step, int threshold);
+int vc_motion_update(IVC* src, IVC* ref, int step);
+int vc_motion_hsv_count(IVC* src, int step, int hmin, int hmax, int smin, int smax, int vmin, int vmax);	// Amostras dentro da segmentação HSV
\ No newline at end of file